@@ -26,6 +26,27 @@ SIM7600::SIM7600(int8_t rst) {
   _rstpin = rst;
   mySerial = 0;
   ok_reply = F("OK");
+  cmdHead = 0;
+  cmdCount = 0;
+  cmdActive = false;
+  cmdLastFailed = false;
+  cmdTail = false;
+  rxlen = 0;
+  urcCount = 0;
+  urcHead = 0;
+  urcStashed = 0;
+  urcDropped = 0;
+  readCommand = 0;
+  readText = false;
+  modemReset = false;
+  nmeaLine = false;
+  memset(&nmeaFix, 0, sizeof(nmeaFix));
+  nmeaStart = 0;
+  linkBaud = 0;
+  probeStep = 0;
+  probeReset = 0;
+  statsCount = 0;
+  invalidateModes();
 }
 
 /**
@@ -36,6 +57,7 @@ SIM7600::SIM7600(int8_t rst) {
  */
 bool SIM7600::begin(Stream &port) {
   mySerial = &port;
+  invalidateModes();
 
   pinMode(_rstpin, OUTPUT);
   digitalWrite(_rstpin, HIGH);
@@ -107,11 +129,277 @@ bool SIM7600::begin(Stream &port) {
 /**
  * @brief  Set the baud rate that the module will use
  *
+ * The rate is saved by the module (AT+IPREX) and used after its next reset.
+ *
  * @param baud The new baud rate to set
  * @return true: success, false: failure
  */
-bool SIM7600::setBaudrate(uint16_t baud) {
-  return sendCheckReply(F("AT+IPREX="), baud, ok_reply);
+bool SIM7600::setBaudrate(uint32_t baud) {
+  if (modeBaud == baud)
+    return true;
+  if (!sendCheckReply(F("AT+IPREX="), baud, ok_reply)) {
+    modeBaud = 0;
+    return false;
+  }
+  modeBaud = baud;
+  return true;
+}
+
+// Rates tried by negotiateBaudrate(), fastest first
+static const uint32_t linkRates[] = {921600, 460800, 230400, 115200, 57600, 9600};
+
+/**
+ * @brief Move the link to the fastest rate that works
+ *
+ * Finds the rate the module currently answers at, then switches both sides
+ * with AT+IPR to the fastest rate up to maxbaud that passes a series of AT
+ * round trips. A rate that fails is abandoned for the next slower one. When
+ * the module answers at no rate at all, it is reset back to its AT+IPREX rate
+ * and wasReset() reports it.
+ *
+ * @param port The host serial port connected to the module, as given to begin()
+ * @param maxbaud The fastest rate to try
+ * @return uint32_t The rate in use, 0 if the module does not answer
+ */
+uint32_t SIM7600::negotiateBaudrate(HardwareSerial &port, uint32_t maxbaud) {
+  uint8_t i;
+
+  // probe, the last known rate and the factory rate first
+  if ((linkBaud == 0) || !checkLink(1)) {
+    // a module that moved on its own has restarted and lost its configuration
+    if (linkBaud != 0)
+      modemReset = true;
+    linkBaud = 0;
+    switchBaudrate(port, SIM7600_DEFAULT_BAUD);
+    if (checkLink(1))
+      linkBaud = SIM7600_DEFAULT_BAUD;
+    for (i = 0; (linkBaud == 0) && (i < sizeof(linkRates) / sizeof(linkRates[0])); i++) {
+      switchBaudrate(port, linkRates[i]);
+      if (checkLink(1))
+        linkBaud = linkRates[i];
+    }
+    // AT+IPR is not saved, a reset brings the module back to a known rate
+    if (linkBaud == 0) {
+      switchBaudrate(port, SIM7600_DEFAULT_BAUD);
+      if (!begin(port))
+        return 0;
+      modemReset = true;
+      linkBaud = SIM7600_DEFAULT_BAUD;
+    }
+  }
+
+  for (i = 0; i < sizeof(linkRates) / sizeof(linkRates[0]); i++) {
+    uint32_t baud = linkRates[i];
+    uint32_t previous = linkBaud;
+
+    if (baud > maxbaud)
+      continue;
+    if (baud == linkBaud)
+      break;
+    // the module answers OK at the old rate, then switches
+    if (!sendCheckReply(F("AT+IPR="), baud, ok_reply))
+      continue;
+    switchBaudrate(port, baud);
+    if (checkLink(SIM7600_LINK_CHECKS)) {
+      linkBaud = baud;
+      break;
+    }
+
+    // go back, the request may be garbled at this rate so insist a little
+    for (uint8_t retry = 0; retry < 3; retry++) {
+      if (sendCheckReply(F("AT+IPR="), previous, ok_reply))
+        break;
+    }
+    switchBaudrate(port, previous);
+    if (!checkLink(2)) {
+      // lost, probe again from scratch
+      linkBaud = 0;
+      return negotiateBaudrate(port, previous);
+    }
+  }
+
+  DebugStream.print(F("Modem link at "));
+  DebugStream.println(linkBaud);
+  return linkBaud;
+}
+
+/**
+ * @brief Find the rate the module answers at, one rate per call
+ *
+ * Unlike negotiateBaudrate(), a call costs at most one AT round trip, so a
+ * scheduler task can look for a lost module without holding the others. The
+ * rate in use is tried first, then the factory rate and the standard rates.
+ * After a whole round without an answer the module is asked to restart,
+ * AT+CFUN=1,1 sent blind at the factory rate, which brings it back to its
+ * AT+IPREX rate, and given SIM7600_BOOT_MS to boot. A module found at another
+ * rate than before has restarted and wasReset() reports it. The rate found is
+ * kept, negotiateBaudrate() is the one that moves to a faster rate.
+ *
+ * @param port The host serial port connected to the module, as given to begin()
+ * @return uint32_t The rate found, 0 while still looking
+ */
+uint32_t SIM7600::probeBaudrate(HardwareSerial &port) {
+  const uint8_t rates = sizeof(linkRates) / sizeof(linkRates[0]);
+  uint32_t baud;
+
+  // the queued transactions time out first
+  if (busy())
+    return 0;
+
+  if (probeReset != 0) {
+    if (millis() - probeReset < SIM7600_BOOT_MS)
+      return 0;
+    probeReset = 0;
+  }
+
+  if (probeStep == 0) {
+    baud = linkBaud;
+  } else if (probeStep == 1) {
+    baud = SIM7600_DEFAULT_BAUD;
+  } else if (probeStep < rates + 2) {
+    baud = linkRates[probeStep - 2];
+  } else {
+    // AT+IPR is not saved, a restart brings the module back to a known rate;
+    // the reset pin given to the constructor is not wired on every board
+    DebugStream.println(F("Modem link lost, restart"));
+    switchBaudrate(port, SIM7600_DEFAULT_BAUD);
+    mySerial->println(F("AT+CFUN=1,1"));
+    invalidateModes();
+    modemReset = true;
+    linkBaud = 0;
+    probeStep = 0;
+    probeReset = millis();
+    return 0;
+  }
+  probeStep++;
+
+  if (baud == 0)
+    return 0;
+  if (probeStep > 1)
+    switchBaudrate(port, baud);
+  if (!checkLink(1))
+    return 0;
+
+  // a module that moved on its own has restarted and lost its configuration
+  if ((linkBaud != 0) && (baud != linkBaud))
+    modemReset = true;
+  linkBaud = baud;
+  probeStep = 0;
+  DebugStream.print(F("Modem link at "));
+  DebugStream.println(linkBaud);
+  return linkBaud;
+}
+
+/**
+ * @brief Check that the module answers AT at the current rate
+ *
+ * @param checks Number of round trips that must all succeed
+ * @return true: success, false: failure
+ */
+bool SIM7600::checkLink(uint8_t checks) {
+  while (checks--) {
+    if (!sendCheckReply(F("AT"), ok_reply, 100))
+      return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Change the rate of the host port
+ *
+ * @param port The host serial port
+ * @param baud The new rate
+ */
+void SIM7600::switchBaudrate(HardwareSerial &port, uint32_t baud) {
+  port.flush(); // let the last command leave at the old rate
+  port.begin(baud);
+  delay(20);
+  flushInput();
+}
+
+/********* Mode cache *************************************************/
+
+/**
+ * @brief Select SMS text or PDU mode
+ *
+ * @param text true: text mode, false: PDU mode
+ * @return true: success, false: failure
+ */
+bool SIM7600::setTextMode(bool text) {
+  if (modeCMGF == text)
+    return true;
+  if (!sendCheckReply(text ? F("AT+CMGF=1") : F("AT+CMGF=0"), ok_reply)) {
+    modeCMGF = -1;
+    return false;
+  }
+  modeCMGF = text;
+  return true;
+}
+
+/**
+ * @brief Show or hide the text mode header parameters
+ *
+ * @param show true: show all header values, false: hide them
+ * @return true: success, false: failure
+ */
+bool SIM7600::setSMSHeaders(bool show) {
+  if (modeCSDH == show)
+    return true;
+  if (!sendCheckReply(show ? F("AT+CSDH=1") : F("AT+CSDH=0"), ok_reply)) {
+    modeCSDH = -1;
+    return false;
+  }
+  modeCSDH = show;
+  return true;
+}
+
+/**
+ * @brief Select how new SMS are indicated
+ *
+ * @param mode AT+CNMI <mode>, 2 to buffer indications while the link is busy
+ * @param mt AT+CNMI <mt>, 1 for a +CMTI notification with the storage slot
+ * @return true: success, false: failure
+ */
+bool SIM7600::setSMSRouting(uint8_t mode, uint8_t mt) {
+  if ((modeCNMI == mode) && (modeCNMIMt == mt))
+    return true;
+  if (!sendCheckReply(F("AT+CNMI="), mode, mt, ok_reply)) {
+    modeCNMI = -1;
+    return false;
+  }
+  modeCNMI = mode;
+  modeCNMIMt = mt;
+  return true;
+}
+
+/**
+ * @brief Forget the cached modem configuration
+ *
+ * The next configuration call will be sent to the modem whatever its value.
+ * Done automatically in begin() and when the modem reports "RDY" after a reset.
+ */
+void SIM7600::invalidateModes(void) {
+  modeCMGF = -1;
+  modeCSDH = -1;
+  modeCNMI = -1;
+  modeCNMIMt = -1;
+  modeGPS = -1;
+  modeBaud = 0;
+  modeNMEA = -1;
+}
+
+/**
+ * @brief Check if the modem restarted on its own
+ *
+ * Its configuration is lost and must be applied again. The flag is cleared
+ * by the call.
+ *
+ * @return true: "RDY" was received since the last call
+ */
+bool SIM7600::wasReset(void) {
+  bool reset = modemReset;
+  modemReset = false;
+  return reset;
 }
 
 /********* Real Time Clock ********************************************/
@@ -416,7 +704,7 @@ int8_t SIM7600::getNumSMS(void) {
   uint16_t numsms;
 
   // get into text mode
-  if (!sendCheckReply(F("AT+CMGF=1"), ok_reply))
+  if (!setTextMode(true))
     return -1;
 
   // ask how many sms are stored
@@ -443,23 +731,27 @@ int8_t SIM7600::getNumSMS(void) {
  */
 bool SIM7600::readSMS(uint8_t message_index, char *smsbuff, uint16_t maxlen, uint16_t *readlen) {
   // text mode
-  if (!sendCheckReply(F("AT+CMGF=1"), ok_reply))
+  if (!setTextMode(true))
     return false;
 
   // show all text mode parameters
-  if (!sendCheckReply(F("AT+CSDH=1"), ok_reply))
+  if (!setSMSHeaders(true))
     return false;
 
   // parse out the SMS len
   uint16_t thesmslen = 0;
+  char sendbuff[16];
 
-  DebugStream.print(F("AT+CMGR="));
-  DebugStream.println(message_index);
+  if (!linkIdle())
+    return false;
 
-  // getReply(F("AT+CMGR="), message_index, 1000);  //  do not print debug!
-  mySerial->print(F("AT+CMGR="));
-  mySerial->println(message_index);
+  // the text is read raw, the engine can't take it
+  sprintf(sendbuff, "AT+CMGR=%u", message_index);
+  startRaw(sendbuff);
   readline(1000); // timeout
+  // the rest of the reply and its final OK are left to the engine
+  cmdTail = !isFinal(replybuffer);
+  cmdStart = millis();
 
   // DebugStream.print(F("Reply: ")); DebugStream.println(replybuffer);
   // parse it out...
@@ -467,13 +759,13 @@ bool SIM7600::readSMS(uint8_t message_index, char *smsbuff, uint16_t maxlen, uin
   DebugStream.println(replybuffer);
 
   if (!parseReply(F("+CMGR:"), &thesmslen, ',', 11)) {
+    finishRaw(isFinal(replybuffer) ? SIM7600_CMD_ERROR : SIM7600_CMD_TIMEOUT);
     *readlen = 0;
     return false;
   }
 
   readRaw(thesmslen);
-
-  flushInput();
+  finishRaw(SIM7600_CMD_OK);
 
   uint16_t thelen = min(maxlen, (uint16_t)strlen(replybuffer));
   strncpy(smsbuff, replybuffer, thelen);
@@ -498,73 +790,81 @@ bool SIM7600::readSMS(uint8_t message_index, char *smsbuff, uint16_t maxlen, uin
  */
 bool SIM7600::getSMSSender(uint8_t message_index, char *sender, int senderlen) {
   // Ensure text mode and all text mode parameters are sent.
-  if (!sendCheckReply(F("AT+CMGF=1"), ok_reply))
+  if (!setTextMode(true))
     return false;
-  if (!sendCheckReply(F("AT+CSDH=1"), ok_reply))
+  if (!setSMSHeaders(true))
+    return false;
+  if (!linkIdle())
     return false;
-
-  DebugStream.print(F("AT+CMGR="));
-  DebugStream.println(message_index);
 
   // Send command to retrieve SMS message and parse a line of response.
-  mySerial->print(F("AT+CMGR="));
-  mySerial->println(message_index);
+  char sendbuff[16];
+  sprintf(sendbuff, "AT+CMGR=%u", message_index);
+  startRaw(sendbuff);
   readline(1000);
+  // The text and the final OK are left to the engine.
+  cmdTail = !isFinal(replybuffer);
+  cmdStart = millis();
 
   DebugStream.println(replybuffer);
 
   // Parse the second field in the response.
   bool result = parseReplyQuoted(F("+CMGR:"), sender, senderlen, ',', 1);
-  // Drop any remaining data from the response.
-  flushInput();
+  finishRaw(result ? SIM7600_CMD_OK : (isFinal(replybuffer) ? SIM7600_CMD_ERROR : SIM7600_CMD_TIMEOUT));
   return result;
 }
 
 /**
  * @brief Send an SMS Message from a buffer provided
  *
+ * Blocking wrapper over sendSMSAsync(), fails at once while queued
+ * transactions are pending
+ *
  * @param smsaddr The SMS address buffer
  * @param smsmsg The SMS message buffer
  * @return true: success, false: failure
  */
 bool SIM7600::sendSMS(char *smsaddr, char *smsmsg) {
-  if (!sendCheckReply(F("AT+CMGF=1"), ok_reply))
+  if (!linkIdle())
     return false;
-
-  char sendcmd[30] = "AT+CMGS=\"";
-  strncpy(sendcmd + 9, smsaddr,
-          30 - 9 - 2); // 9 bytes beginning, 2 bytes for close quote + null
-  sendcmd[strlen(sendcmd)] = '\"';
-
-  if (!sendCheckReply(sendcmd, F("> ")))
+  syncDone = false;
+  if (!sendSMSAsync(smsaddr, smsmsg, onSyncReply, this))
     return false;
+  while (!syncDone) {
+    process();
+    yield();
+  }
 
-  DebugStream.print(F("> "));
-  DebugStream.println(smsmsg);
-
-  mySerial->println(smsmsg);
-  mySerial->println();
-  mySerial->write(0x1A);
-
-  DebugStream.println("^Z");
-
-  // Eat two sets of CRLF
-  readline(200);
-  // DebugStream.print("Line 1: "); DebugStream.println(strlen(replybuffer));
-  readline(200);
-  // DebugStream.print("Line 2: "); DebugStream.println(strlen(replybuffer));
-  readline(10000); // read the +CMGS reply, wait up to 10 seconds!!!
+  return (syncResult == SIM7600_CMD_OK);
+}
 
-  if (strstr(replybuffer, "+CMGS") == 0) {
+/**
+ * @brief Queue an SMS Message without waiting for it to be sent
+ *
+ * The message is copied, so the buffers can be reused as soon as this returns.
+ *
+ * @param smsaddr The SMS address buffer
+ * @param smsmsg The SMS message buffer
+ * @param callback Called with SIM7600_CMD_OK once the +CMGS reply is received
+ * @param ctx Passed back to the callback
+ * @return true: queued, false: not enough room in the command queue
+ */
+bool SIM7600::sendSMSAsync(char *smsaddr, char *smsmsg, SIM7600Callback callback, void *ctx) {
+  if (queueSpace() < 3)
     return false;
-  }
-  readline(1000); // read OK
 
-  if (strcmp(replybuffer, "OK") != 0) {
-    return false;
-  }
+  char sendcmd[30];
+  snprintf(sendcmd, sizeof(sendcmd), "AT+CMGS=\"%.18s\"", smsaddr);
 
-  return true;
+  // only chain on AT+CMGF if it is sent, not on an unrelated transaction
+  uint8_t flags = 0;
+  if (modeCMGF != 1) {
+    queueCommand("AT+CMGF=1", ok_reply, DEFAULT_TIMEOUT_MS, onTextMode, this);
+    flags = SIM7600_CMD_CHAINED;
+  }
+  queueCommand(sendcmd, F("> "), DEFAULT_TIMEOUT_MS, 0, 0, flags);
+  // wait up to 10 seconds for the +CMGS reply
+  return queueCommand(smsmsg, F("+CMGS"), 10000, callback, ctx, SIM7600_CMD_CHAINED | SIM7600_CMD_PAYLOAD);
 }
 
 /**
@@ -574,7 +874,7 @@ bool SIM7600::sendSMS(char *smsaddr, char *smsmsg) {
  * @return true: success, false: failure
  */
 bool SIM7600::deleteSMS(uint8_t message_index) {
-  if (!sendCheckReply(F("AT+CMGF=1"), ok_reply))
+  if (!setTextMode(true))
     return false;
   // read an sms
   char sendbuff[12] = "AT+CMGD=000";
@@ -587,6 +887,99 @@ bool SIM7600::deleteSMS(uint8_t message_index) {
   return sendCheckReply(sendbuff, ok_reply, 2000);
 }
 
+/**
+ * @brief List every stored SMS with a single AT+CMGL
+ *
+ * Sender and text of each message are parsed in the same pass. Listing marks
+ * the unread messages as read, so deleteReadSMS() removes them all once they
+ * have been processed. The line that follows a header is text whatever it
+ * says, an SMS that reads "OK" does not end the listing.
+ *
+ * @param inbox Array to fill with the messages
+ * @param maxsms Size of the inbox array
+ * @param total Optional, set to the number of stored messages, which may be
+ * more than maxsms
+ * @return int8_t The number of messages copied into inbox, -1 on error
+ */
+int8_t SIM7600::listSMS(SIM7600SMS *inbox, uint8_t maxsms, uint8_t *total) {
+  SIM7600SMS *current = 0;
+  uint8_t count = 0;
+  uint8_t seen = 0;
+  uint16_t index;
+  bool text;
+  uint8_t result = SIM7600_CMD_TIMEOUT;
+
+  // text mode, the header ends with the text length
+  if (!setTextMode(true))
+    return -1;
+  if (!setSMSHeaders(true))
+    return -1;
+
+  // an SMS from the outbox may be in flight, come back later
+  if (!linkIdle())
+    return -1;
+
+  // the texts are read line by line, the engine can't take them
+  startRaw("AT+CMGL=\"ALL\"");
+
+  // +CMGL: <index>,<stat>,<oa>,...,<length> header line followed by the
+  // text, its first line is not a URC nor the end of the reply even if it
+  // looks like "RING", "+CMTI" or "OK"
+  while (true) {
+    if (readline(5000) == 0)
+      break;
+    text = readText;
+    readText = false;
+    if (!text && isFinal(replybuffer)) {
+      result = (strcmp(replybuffer, "OK") == 0) ? SIM7600_CMD_OK : SIM7600_CMD_ERROR;
+      break;
+    }
+
+    if (!text && (strncmp(replybuffer, "+CMGL: ", 7) == 0) && parseReply(F("+CMGL: "), &index)) {
+      // an empty message has no text line
+      const char *length = strrchr(replybuffer, ',');
+      readText = (length == 0) || (atoi(length + 1) > 0);
+      seen++;
+      current = 0;
+      if (count < maxsms) {
+        current = &inbox[count++];
+        current->index = index;
+        if (!parseReplyQuoted(F("+CMGL: "), current->sender, SIM7600_SMS_SENDER_LEN, ',', 2))
+          current->sender[0] = 0;
+        current->sender[SIM7600_SMS_SENDER_LEN] = 0;
+        current->text[0] = 0;
+      }
+    } else if (current != 0) {
+      // the text may span several lines
+      uint16_t len = strlen(current->text);
+      if (len && (len < SIM7600_SMS_TEXT_LEN))
+        current->text[len++] = '\n';
+      strncpy(current->text + len, replybuffer, SIM7600_SMS_TEXT_LEN - len);
+      current->text[SIM7600_SMS_TEXT_LEN] = 0;
+    }
+  }
+  finishRaw(result);
+  if (result != SIM7600_CMD_OK)
+    return -1;
+
+  DebugStream.print(F("\t<--- "));
+  DebugStream.print(seen);
+  DebugStream.println(F(" SMS"));
+
+  if (total)
+    *total = seen;
+  return count;
+}
+
+/**
+ * @brief Delete every SMS already read in one command
+ *
+ * @return true: success, false: failure
+ */
+bool SIM7600::deleteReadSMS(void) {
+  return sendCheckReply(F("AT+CMGD=1,1"), ok_reply, 5000);
+}
+
 /********* USSD *********************************************************/
 
 /**
@@ -654,8 +1047,6 @@ bool SIM7600::enableNetworkTimeSync(bool onoff) {
       return false;
   }
 
-  flushInput(); // eat any 'Unsolicted Result Code'
-
   return true;
 }
 
@@ -730,6 +1121,9 @@ bool SIM7600::getTime(char *time_buffer, uint16_t maxlen) {
 bool SIM7600::enableGPS(bool onoff) {
   uint16_t state;
 
+  if (modeGPS == onoff)
+    return true;
+
   // first check if its already on or off
   if (!SIM7600::sendParseReply(F("AT+CGPS?"), F("+CGPS: "), &state))
     return false;
@@ -743,6 +1137,7 @@ bool SIM7600::enableGPS(bool onoff) {
     // this takes a little time
     readline(2000); // eat '+CGPS: 0'
   }
+  modeGPS = onoff;
   return true;
 }
 
@@ -795,138 +1190,92 @@ uint8_t SIM7600::getGPS(uint8_t arg, char *buffer, uint8_t maxbuff) {
 }
 
 /**
- * @brief Get a GPS reading
+ * @brief Get a GPS reading in fixed point
  *
- * @param lat  Pointer to a buffer to be filled with thelatitude
- * @param lon Pointer to a buffer to be filled with the longitude
- * @param time Pointer to a buffer to be filled with the time
- * kilometers per hour
- * @param date Pointer to a buffer to be filled with the date
- * @param altitude Pointer to a buffer to be filled with the altitude
- * @return true: success, false: failure
+ * @param pos Pointer to the position to fill
+ * @return true: success, false: no fix
  */
-bool SIM7600::getGPS(float *lat, float *lon, time_t *datetime, float *altitude) {
-  tmElements_t tSet;
-  char dd[3], mm[3], yy[3], hh[3], nn[3], ss[3];
-  char gpsbuffer[120];
+bool SIM7600::getGPS(SIM7600Position *pos) {
+  SIM7600Field fields[SIM7600_MAX_FIELDS];
+  int32_t dd, mm, yy, hh, nn, ss;
 
-  memset(dd, '\0', 3);              // Initialize the string
-  memset(mm, '\0', 3);              // Initialize the string
-  memset(yy, '\0', 3);              // Initialize the string
-  memset(hh, '\0', 3);              // Initialize the string
-  memset(nn, '\0', 3);              // Initialize the string
-  memset(ss, '\0', 3);              // Initialize the string
+  // +CGPSINFO:4043.000000,N,07400.000000,W,151015,203802.1,-12.0,0.0,0
+  // or +CGPSINFO: ,,,,,,,, without a fix
+  // the fields point into replybuffer, the trailing OK is left to the engine
+  getReply(F("AT+CGPSINFO"));
+  uint8_t count = tokenize(F("+CGPSINFO:"), ',', fields, SIM7600_MAX_FIELDS);
 
   // we need at least a 2D fix
-  if (GPSstatus() < 2)
+  if ((count < 7) || (fields[4].len < 6) || (fields[5].len < 6))
     return false;
-
-  // grab the mode 2^5 gps csv from the sim808
-  uint8_t res_len = getGPS(32, gpsbuffer, 120);
-
-  // make sure we have a response
-  if (res_len == 0)
+  if (!fieldToMicroDegrees(fields[0], fields[1], &pos->lat) || !fieldToMicroDegrees(fields[2], fields[3], &pos->lon))
     return false;
+  if (!fieldToFixed(fields[6], 3, &pos->altitude))
+    pos->altitude = 0;
+
+  // date ddmmyy, time hhmmss.s
+  SIM7600Field date[3] = {{fields[4].p, 2}, {fields[4].p + 2, 2}, {fields[4].p + 4, 2}};
+  SIM7600Field time[3] = {{fields[5].p, 2}, {fields[5].p + 2, 2}, {fields[5].p + 4, 2}};
+  if (!fieldToInt(date[0], &dd) || !fieldToInt(date[1], &mm) || !fieldToInt(date[2], &yy) ||
+      !fieldToInt(time[0], &hh) || !fieldToInt(time[1], &nn) || !fieldToInt(time[2], &ss))
+    return false;
+  pos->datetime = calendarToEpoch(2000 + yy, mm, dd, hh, nn, ss);
 
-    // Parse 3G respose
-    // +CGPSINFO:4043.000000,N,07400.000000,W,151015,203802.1,-12.0,0.0,0
-    // skip beginning
-
-    // grab the latitude
-    char *latp = strtok(gpsbuffer, ",");
-    if (!latp)
-      return false;
-
-    // grab latitude direction
-    char *latdir = strtok(NULL, ",");
-    if (!latdir)
-      return false;
-
-    // grab longitude
-    char *longp = strtok(NULL, ",");
-    if (!longp)
-      return false;
-
-    // grab longitude direction
-    char *longdir = strtok(NULL, ",");
-    if (!longdir)
-      return false;
-
-    // date
-    char *gpsDate = strtok(NULL, ",");
-    if (!gpsDate)
-      return false;
-    // Day
-    strncpy(dd, gpsDate, 2);
-    dd[2] = '\0';
-    tSet.Day = atoi(dd);
-    // Month
-    strncpy(mm, gpsDate + 2, 2);
-    mm[2] = '\0';
-    tSet.Month = atoi(mm);
-    // Year
-    strncpy(yy, gpsDate + 4, 2);
-    yy[2] = '\0';
-    tSet.Year = atoi(yy);
-
-    // time
-    char *gpsTime = strtok(NULL, ",");
-    if (!gpsTime)
-      return false;
-    // Hour
-    strncpy(hh, gpsTime, 2);
-    hh[2] = '\0';
-    tSet.Hour = atoi(hh);
-    // Minute
-    strncpy(nn, gpsTime + 2, 2);
-    nn[2] = '\0';
-    tSet.Minute = atoi(nn);
-    // Second
-    strncpy(ss, gpsTime + 4, 2);
-    ss[2] = '\0';
-    tSet.Second = atoi(ss);
-
-    *datetime = makeTime(tSet);
-    
-    // only grab altitude if needed
-    if (altitude != NULL) {
-      // grab altitude
-      char *altp = strtok(NULL, ",");
-      if (!altp)
-        return false;
-      *altitude = atof(altp);
-    }
-
-    double latitude = atof(latp);
-    double longitude = atof(longp);
-
-    // convert latitude from minutes to decimal
-    float degrees = floor(latitude / 100);
-    double minutes = latitude - (100 * degrees);
-    minutes /= 60;
-    degrees += minutes;
-
-    // turn direction into + or -
-    if (latdir[0] == 'S')
-      degrees *= -1;
-
-    *lat = degrees;
+  return true;
+}
 
-    // convert longitude from minutes to decimal
-    degrees = floor(longitude / 100);
-    minutes = longitude - (100 * degrees);
-    minutes /= 60;
-    degrees += minutes;
+/**
+ * @brief Get a GPS reading
+ *
+ * Floating point wrapper over getGPS(SIM7600Position *)
+ *
+ * @param lat  Pointer to a buffer to be filled with thelatitude
+ * @param lon Pointer to a buffer to be filled with the longitude
+ * @param datetime Pointer to a buffer to be filled with the date and time
+ * @param altitude Pointer to a buffer to be filled with the altitude
+ * @return true: success, false: failure
+ */
+bool SIM7600::getGPS(float *lat, float *lon, time_t *datetime, float *altitude) {
+  SIM7600Position pos;
 
-    // turn direction into + or -
-    if (longdir[0] == 'W')
-      degrees *= -1;
+  if (!getGPS(&pos))
+    return false;
 
-    *lon = degrees;
+  *lat = pos.lat / 1000000.0f;
+  *lon = pos.lon / 1000000.0f;
+  if (datetime != NULL)
+    *datetime = pos.datetime;
+  if (altitude != NULL)
+    *altitude = pos.altitude / 1000.0f;
 
   return true;
 }
 
+/**
+ * @brief Convert a UTC calendar date and time to seconds since 1970
+ *
+ * Integer only, no tmElements_t needed.
+ *
+ * @param year Full year, e.g. 2024
+ * @param month 1 to 12
+ * @param day 1 to 31
+ * @param hour 0 to 23
+ * @param minute 0 to 59
+ * @param second 0 to 59
+ * @return time_t The matching Unix time
+ */
+time_t SIM7600::calendarToEpoch(uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second) {
+  // days since 1970-01-01, counting years from March so that the leap day comes last
+  int32_t y = year - (month <= 2);
+  int32_t era = y / 400;
+  int32_t yoe = y - era * 400;
+  int32_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  int32_t days = era * 146097 + doe - 719468;
+
+  return (time_t)days * 86400 + hour * 3600 + minute * 60 + second;
+}
+
 /**
  * @brief Enable GPS NMEA output
 
@@ -949,84 +1298,999 @@ bool SIM7600::enableGPSNMEA(uint8_t enable_value) {
   return sendCheckReply(sendbuff, ok_reply, 2000);
 }
 
-/********* HELPERS *********************************************/
-
 /**
- * @brief Check if the received reply matches the expectation
+ * @brief Have the modem report NMEA sentences on the AT port
  *
- * @param reply The expected reply
- * @param timeout Read timeout
+ * The RMC, GGA and GSA sentences are decoded as they arrive, whatever the
+ * driver is doing, and read back with getFix().
+ *
+ * @param seconds Reporting period, 0 to stop
  * @return true: success, false: failure
  */
-bool SIM7600::expectReply(SIM7600FlashStringPtr reply, uint16_t timeout) {
-  readline(timeout);
-
-  DebugStream.print(F("\t<--- "));
-  DebugStream.println(replybuffer);
+bool SIM7600::reportNMEA(uint8_t seconds) {
+  if (modeNMEA == seconds)
+    return true;
 
-  return (strcmp(replybuffer, (prog_char *)reply) == 0);
+  // <nmea> bit 0: GGA, bit 1: RMC, bit 3: GSA
+  if (!sendCheckReply(F("AT+CGPSINFOCFG="), seconds, 11, ok_reply)) {
+    modeNMEA = -1;
+    return false;
+  }
+  modeNMEA = seconds;
+  // a new session, the fix has to be acquired again
+  nmeaFix.valid = false;
+  nmeaFix.ttff = 0;
+  nmeaStart = millis();
+  return true;
 }
 
-/********* LOW LEVEL *******************************************/
-
 /**
- * @brief Serial data available
+ * @brief Get the last state decoded from the NMEA stream
  *
- * @return int
- */
-inline int SIM7600::available(void) { return mySerial->available(); } ///<
-/**
- * @brief Serial write
+ * Nothing is sent to the modem.
  *
- * @param x
- * @return size_t
+ * @param fix Pointer to the state to fill
+ * @return true: the last RMC reported a valid fix
  */
-inline size_t SIM7600::write(uint8_t x) {
-  return mySerial->write(x);
-} ///<
+bool SIM7600::getFix(SIM7600Fix *fix) {
+  *fix = nmeaFix;
+  return nmeaFix.valid;
+}
+
+/********* NMEA *********************************************************/
+
+#define NMEA_OTHER 0
+#define NMEA_RMC 1
+#define NMEA_GGA 2
+#define NMEA_GSA 3
+
 /**
- * @brief Serial read
+ * @brief Take the NMEA sentences out of the characters read from the UART
  *
- * @return int
- */
-inline int SIM7600::read(void) { return mySerial->read(); } ///<
-/**
- * @brief Serial peek
+ * A line starting with '$' is a sentence, it goes to the decoder up to its
+ * CR or LF.
  *
- * @return int
+ * @param c The character read from the UART
+ * @param lineStart true when c is the first character of a line
+ * @return true: c belongs to a sentence, false: it is for the caller
  */
-inline int SIM7600::peek(void) { return mySerial->peek(); } ///<
+bool SIM7600::takeNMEA(char c, bool lineStart) {
+  if (lineStart && (c == '$'))
+    nmeaLine = true;
+  return nmeaLine && encodeNMEA(c);
+}
+
 /**
- * @brief Flush the serial data
+ * @brief Decode one character of an NMEA sentence
  *
- */
-inline void SIM7600::flush() { mySerial->flush(); } ///<
-/**
- * @brief Read all available serial input to flush pending data.
+ * Fields are decoded as soon as their divider is received, the values are
+ * only kept once the checksum is verified. A sentence whose CR was lost is
+ * given up on the first character of the next AT line ('+', or 'O' of "OK"
+ * after a decoded sentence) or once it is longer than SIM7600_NMEA_MAXLEN.
  *
+ * @param c The character read from the UART
+ * @return true: c was decoded, false: the sentence was given up and c starts
+ * a new line
  */
-void SIM7600::flushInput() {
-  uint16_t timeoutloop = 0;
-  while (timeoutloop++ < 40) {
-    while (available()) {
-      read();
-      timeoutloop = 0; // If char was received reset the timer
+bool SIM7600::encodeNMEA(char c) {
+  if ((c != '$') && ((c == '+') || ((c == 'O') && (nmeaSentence != NMEA_OTHER)) || (nmeaLength >= SIM7600_NMEA_MAXLEN))) {
+    nmeaFix.errors++;
+    nmeaLine = false;
+    return false;
+  }
+  nmeaLength++;
+
+  switch (c) {
+  case '$':
+    nmeaSentence = NMEA_OTHER;
+    nmeaTermNum = 0;
+    nmeaTermLen = 0;
+    nmeaParity = 0;
+    nmeaLength = 1;
+    nmeaInChecksum = false;
+    nmeaNew = nmeaFix;
+    break;
+
+  case ',':
+    nmeaParity ^= c;
+    decodeNMEATerm();
+    nmeaTermNum++;
+    nmeaTermLen = 0;
+    break;
+
+  case '*':
+    decodeNMEATerm();
+    nmeaInChecksum = true;
+    nmeaTermLen = 0;
+    break;
+
+  case '\r':
+  case '\n':
+    if (nmeaInChecksum && (nmeaSentence != NMEA_OTHER)) {
+      nmeaTerm[nmeaTermLen] = 0;
+      if (strtol(nmeaTerm, 0, 16) == nmeaParity)
+        commitNMEA();
+      else
+        nmeaFix.errors++;
     }
-    delay(1);
+    nmeaLine = false;
+    break;
+
+  default:
+    if (!nmeaInChecksum)
+      nmeaParity ^= c;
+    if (nmeaTermLen < SIM7600_NMEA_TERMLEN - 1)
+      nmeaTerm[nmeaTermLen++] = c;
+    break;
   }
+  return true;
 }
+
 /**
- * @brief Read directly into the reply buffer
+ * @brief Decode the field just received into nmeaNew
  *
- * @param read_length The number of bytes to return
+ */
+void SIM7600::decodeNMEATerm(void) {
+  SIM7600Field term = {nmeaTerm, nmeaTermLen};
+  SIM7600Field none = {nmeaTerm, 0};
+  int32_t v;
+
+  // talker GP, GL, GN... followed by the sentence type
+  if (nmeaTermNum == 0) {
+    if (nmeaTermLen != 5)
+      nmeaSentence = NMEA_OTHER;
+    else if (strncmp(nmeaTerm + 2, "RMC", 3) == 0)
+      nmeaSentence = NMEA_RMC;
+    else if (strncmp(nmeaTerm + 2, "GGA", 3) == 0)
+      nmeaSentence = NMEA_GGA;
+    else if (strncmp(nmeaTerm + 2, "GSA", 3) == 0)
+      nmeaSentence = NMEA_GSA;
+    else
+      nmeaSentence = NMEA_OTHER;
+    return;
+  }
+
+  switch (nmeaSentence) {
+  case NMEA_RMC:
+    // $GPRMC,hhmmss.ss,A,ddmm.mmmm,N,dddmm.mmmm,E,speed,course,ddmmyy,...
+    switch (nmeaTermNum) {
+    case 1:
+      if (nmeaTermLen >= 6) {
+        int32_t hh, mm, ss;
+        SIM7600Field t[3] = {{nmeaTerm, 2}, {nmeaTerm + 2, 2}, {nmeaTerm + 4, 2}};
+        if (fieldToInt(t[0], &hh) && fieldToInt(t[1], &mm) && fieldToInt(t[2], &ss))
+          nmeaTime = hh * 3600L + mm * 60 + ss;
+      }
+      break;
+    case 2:
+      nmeaNew.valid = (nmeaTermLen == 1) && (nmeaTerm[0] == 'A');
+      break;
+    case 3:
+    case 5:
+      if (fieldToMicroDegrees(term, none, &v))
+        *(nmeaTermNum == 3 ? &nmeaNew.pos.lat : &nmeaNew.pos.lon) = v;
+      break;
+    case 4:
+    case 6:
+      // the coordinate is received first, positive
+      if ((nmeaTermLen == 1) && ((nmeaTerm[0] == 'S') || (nmeaTerm[0] == 'W'))) {
+        int32_t *coord = (nmeaTermNum == 4 ? &nmeaNew.pos.lat : &nmeaNew.pos.lon);
+        *coord = -*coord;
+      }
+      break;
+    case 9:
+      if (nmeaTermLen == 6) {
+        for (uint8_t i = 0; i < 3; i++) {
+          SIM7600Field d = {nmeaTerm + 2 * i, 2};
+          if (fieldToInt(d, &v))
+            nmeaDate[i] = v;
+        }
+      }
+      break;
+    }
+    break;
+
+  case NMEA_GGA:
+    // $GPGGA,hhmmss.ss,lat,N,lon,E,quality,satellites,hdop,altitude,M,...
+    switch (nmeaTermNum) {
+    case 6:
+      if (fieldToInt(term, &v))
+        nmeaNew.quality = v;
+      break;
+    case 7:
+      if (fieldToInt(term, &v))
+        nmeaNew.satellites = v;
+      break;
+    case 8:
+      if (fieldToFixed(term, 2, &v))
+        nmeaNew.hdop = v;
+      break;
+    case 9:
+      if (fieldToFixed(term, 3, &v))
+        nmeaNew.pos.altitude = v;
+      break;
+    }
+    break;
+
+  case NMEA_GSA:
+    // $GPGSA,A,3,...
+    if ((nmeaTermNum == 2) && fieldToInt(term, &v))
+      nmeaNew.fixType = v;
+    break;
+  }
+}
+
+/**
+ * @brief Keep the values of a sentence whose checksum is correct
+ *
+ */
+void SIM7600::commitNMEA(void) {
+  nmeaFix.sentences++;
+
+  switch (nmeaSentence) {
+  case NMEA_RMC:
+    nmeaFix.valid = nmeaNew.valid;
+    if (nmeaNew.valid) {
+      nmeaFix.pos.lat = nmeaNew.pos.lat;
+      nmeaFix.pos.lon = nmeaNew.pos.lon;
+      nmeaFix.pos.datetime = calendarToEpoch(2000 + nmeaDate[2], nmeaDate[1], nmeaDate[0], 0, 0, 0) + nmeaTime;
+      nmeaFix.updated = millis();
+      if (nmeaFix.ttff == 0)
+        nmeaFix.ttff = max(nmeaFix.updated - nmeaStart, (uint32_t)1);
+    }
+    break;
+
+  case NMEA_GGA:
+    nmeaFix.quality = nmeaNew.quality;
+    nmeaFix.satellites = nmeaNew.satellites;
+    nmeaFix.hdop = nmeaNew.hdop;
+    if (nmeaNew.quality)
+      nmeaFix.pos.altitude = nmeaNew.pos.altitude;
+    break;
+
+  case NMEA_GSA:
+    nmeaFix.fixType = nmeaNew.fixType;
+    break;
+  }
+}
+
+/********* COMMAND ENGINE *********************************************/
+
+/**
+ * @brief Queue an AT transaction
+ *
+ * The transaction is sent by poll() once every transaction queued before it
+ * is done. It succeeds when a line starting with expect has been received
+ * together with the final OK (a "> " prompt or an expected "OK" completes it
+ * on its own). Without expect, the first line received completes it.
+ *
+ * @param send The command (or payload) to send, copied into the queue
+ * @param expect The expected reply prefix, 0 to complete on the first line
+ * @param timeout Timeout in ms, counted from the moment the command is sent
+ * @param callback Called once the transaction is done, may be 0
+ * @param ctx Passed back to the callback
+ * @param flags SIM7600_CMD_CHAINED and/or SIM7600_CMD_PAYLOAD
+ * @return true: queued, false: the queue is full
+ */
+bool SIM7600::queueCommand(const char *send, SIM7600FlashStringPtr expect, uint16_t timeout,
+                           SIM7600Callback callback, void *ctx, uint8_t flags) {
+  if (cmdCount >= SIM7600_CMD_QUEUE_SIZE)
+    return false;
+
+  SIM7600Command *cmd = &cmdQueue[(cmdHead + cmdCount) % SIM7600_CMD_QUEUE_SIZE];
+  strncpy(cmd->send, send, SIM7600_CMD_MAXLEN - 1);
+  cmd->send[SIM7600_CMD_MAXLEN - 1] = 0;
+  cmd->expect = expect;
+  cmd->timeout = timeout;
+  cmd->flags = flags;
+  cmd->callback = callback;
+  cmd->ctx = ctx;
+  cmdCount++;
+  return true;
+}
+
+/**
+ * @brief Advance the command engine without blocking
+ *
+ * Sends the next queued command when idle, consumes whatever the UART holds,
+ * completes the active transaction on match, error or timeout and hands the
+ * stashed URCs to their handlers. Call it often, typically from a
+ * TaskScheduler task.
+ */
+void SIM7600::poll(void) {
+  process();
+  dispatchURC();
+}
+
+/**
+ * @brief Run the command engine once, without dispatching URCs
+ *
+ * Used by the blocking wrappers so that URC handlers never run in the middle
+ * of a command.
+ */
+void SIM7600::process(void) {
+  if (mySerial == 0)
+    return;
+
+  // a final OK lost after a reply taken on its first line
+  if (cmdTail && (millis() - cmdStart >= SIM7600_TAIL_MS))
+    cmdTail = false;
+
+  if (!cmdActive && !cmdTail && cmdCount)
+    startCommand();
+
+  while (mySerial->available()) {
+    if (assemble(mySerial->read()))
+      handleLine();
+  }
+
+  if (cmdActive && (millis() - cmdStart >= cmdQueue[cmdHead].timeout)) {
+    // A matched reply whose final OK got lost still counts
+    finishCommand(cmdMatched ? SIM7600_CMD_OK : SIM7600_CMD_TIMEOUT);
+  }
+}
+
+/**
+ * @brief Check if the command engine has work pending
+ *
+ * @return true: a transaction is queued or in flight
+ */
+bool SIM7600::busy(void) { return (cmdCount != 0); }
+
+/**
+ * @brief Get the number of free slots in the command queue
+ *
+ * @return uint8_t The number of transactions that can still be queued
+ */
+uint8_t SIM7600::queueSpace(void) { return SIM7600_CMD_QUEUE_SIZE - cmdCount; }
+
+/**
+ * @brief Add a character to the line being assembled
+ *
+ * @param c The character read from the UART
+ * @return true when rxline holds a complete line
+ */
+bool SIM7600::assemble(char c) {
+  bool complete;
+
+  // NMEA sentences go to the decoder and never reach the line handler
+  if (takeNMEA(c, rxlen == 0))
+    return false;
+
+  if (c == '\r')
+    return false;
+  if (c == '\n') {
+    complete = (rxlen != 0); // empty lines are ignored
+  } else {
+    rxline[rxlen++] = c;
+    rxline[rxlen] = 0;
+    // the SMS prompt is not followed by a newline
+    complete = ((rxlen == 2) && (rxline[0] == '>') && (rxline[1] == ' ')) || (rxlen >= sizeof(rxline) - 1);
+  }
+
+  // the modem restarted, whatever was configured is lost
+  if (complete && (strcmp(rxline, "RDY") == 0)) {
+    invalidateModes();
+    modemReset = true;
+  }
+  return complete;
+}
+
+/**
+ * @brief Match a complete line against the active transaction
+ *
+ */
+void SIM7600::handleLine(void) {
+  if (cmdActive) {
+    SIM7600Command *cmd = &cmdQueue[cmdHead];
+    bool isOK = (strcmp(rxline, "OK") == 0);
+    bool isExpected = (cmd->expect != 0) && (strncmp(rxline, (prog_char *)cmd->expect, strlen((prog_char *)cmd->expect)) == 0);
+
+    if (!isExpected && !isOwnReply(rxline, cmd->send) && isURC(rxline)) {
+      stashURC(rxline);
+    } else if (cmd->expect == 0) {
+      strcpy(cmdReply, rxline);
+      finishCommand(SIM7600_CMD_OK);
+    } else if (!cmdMatched && isExpected) {
+      strcpy(cmdReply, rxline);
+      cmdMatched = true;
+      if (cmdGotOK || isOK || (rxline[0] == '>'))
+        finishCommand(SIM7600_CMD_OK);
+    } else if (isOK) {
+      cmdGotOK = true;
+      if (cmdMatched)
+        finishCommand(SIM7600_CMD_OK);
+    } else if ((strcmp(rxline, "ERROR") == 0) || (strncmp(rxline, "+CME ERROR", 10) == 0) ||
+               (strncmp(rxline, "+CMS ERROR", 10) == 0)) {
+      strcpy(cmdReply, rxline);
+      finishCommand(SIM7600_CMD_ERROR);
+    }
+  } else if (cmdTail) {
+    // rest of the reply taken on its first line, the next command goes after its end
+    if (isFinal(rxline))
+      cmdTail = false;
+  } else if (isURC(rxline)) {
+    stashURC(rxline);
+  }
+  rxlen = 0;
+  rxline[0] = 0;
+}
+
+/**
+ * @brief Check if a line is a final result code
+ *
+ * @param line The line to check
+ * @return true: OK, ERROR, +CME ERROR or +CMS ERROR
+ */
+bool SIM7600::isFinal(const char *line) {
+  return (strcmp(line, "OK") == 0) || (strcmp(line, "ERROR") == 0) || (strncmp(line, "+CME ERROR", 10) == 0) ||
+         (strncmp(line, "+CMS ERROR", 10) == 0);
+}
+
+/**
+ * @brief Send the transaction at the head of the queue
+ *
+ */
+void SIM7600::startCommand(void) {
+  SIM7600Command *cmd = &cmdQueue[cmdHead];
+
+  if ((cmd->flags & SIM7600_CMD_CHAINED) && cmdLastFailed) {
+    finishCommand(SIM7600_CMD_ABORTED);
+    return;
+  }
+
+  DebugStream.print(F("\t---> "));
+  DebugStream.println(cmd->send);
+
+  if (cmd->flags & SIM7600_CMD_PAYLOAD) {
+    mySerial->println(cmd->send);
+    mySerial->println();
+    mySerial->write(0x1A);
+  } else {
+    mySerial->println(cmd->send);
+  }
+
+  cmdActive = true;
+  cmdMatched = false;
+  cmdGotOK = false;
+  cmdReply[0] = 0;
+  cmdStart = millis();
+  cmdStartUs = micros();
+}
+
+/**
+ * @brief Pop the head transaction and report its result
+ *
+ * The queue is updated before the callback runs so that the callback can
+ * queue follow-up commands.
+ *
+ * @param result One of SIM7600_CMD_xxx
+ */
+void SIM7600::finishCommand(uint8_t result) {
+  SIM7600Command *cmd = &cmdQueue[cmdHead];
+  SIM7600Callback callback = cmd->callback;
+  void *ctx = cmd->ctx;
+
+  if (result != SIM7600_CMD_ABORTED) {
+    DebugStream.print(F("\t<--- "));
+    DebugStream.println(cmdReply);
+    recordStats(cmd, result);
+  }
+
+  if (result == SIM7600_CMD_TIMEOUT) {
+    // hand back whatever was received
+    strcpy(cmdReply, rxline);
+    // don't leave the modem waiting for an SMS body
+    if ((cmd->expect != 0) && (((prog_char *)cmd->expect)[0] == '>'))
+      mySerial->write(0x1B);
+  }
+
+  // the final result of a reply taken on its first line is still to come,
+  // the next command waits for it instead of taking it for its own reply
+  cmdTail = (result == SIM7600_CMD_OK) && (cmd->expect == 0) && !isFinal(cmdReply);
+  if (cmdTail)
+    cmdStart = millis();
+
+  cmdLastFailed = (result != SIM7600_CMD_OK);
+  cmdActive = false;
+  cmdHead = (cmdHead + 1) % SIM7600_CMD_QUEUE_SIZE;
+  cmdCount--;
+
+  if (callback)
+    callback(result, cmdReply, ctx);
+}
+
+/**
+ * @brief Make the UART free for a blocking exchange
+ *
+ * Queued transactions are never waited for, an SMS may take 10 s: the
+ * blocking wrappers give up instead and are called again later. Only the
+ * final OK of a reply taken on its first line is waited for, at most
+ * SIM7600_TAIL_MS.
+ *
+ * @return true: nothing queued, the exchange can start
+ */
+bool SIM7600::linkIdle(void) {
+  if (cmdCount)
+    return false;
+  process();
+  while (cmdTail) {
+    process();
+    yield();
+  }
+  return true;
+}
+
+/**
+ * @brief Send a command through the engine and wait for the first line of reply
+ *
+ * Nothing is sent while queued transactions are pending, syncResult is then
+ * SIM7600_CMD_BUSY.
+ *
+ * @param send The command to send
+ * @param timeout Timeout for reading a response
+ * @return uint8_t The response length, 0 when busy
+ */
+uint8_t SIM7600::transact(const char *send, uint16_t timeout) {
+  if (!linkIdle()) {
+    replybuffer[0] = 0;
+    syncResult = SIM7600_CMD_BUSY;
+    return 0;
+  }
+
+  syncDone = false;
+  queueCommand(send, 0, timeout, onSyncReply, this);
+  while (!syncDone) {
+    process();
+    yield();
+  }
+
+  return strlen(replybuffer);
+}
+
+/**
+ * @brief Send a command whose reply is read with readline(), outside the queue
+ *
+ * For the replies the engine can't take, such as SMS texts. The caller checks
+ * linkIdle() first and ends the exchange with finishRaw().
+ *
+ * @param send The command, kept until finishRaw()
+ */
+void SIM7600::startRaw(const char *send) {
+  DebugStream.print(F("\t---> "));
+  DebugStream.println(send);
+
+  mySerial->println(send);
+  readCommand = send;
+  readText = false;
+  cmdStartUs = micros();
+}
+
+/**
+ * @brief End an exchange started by startRaw(), accounted like a transaction
+ *
+ * @param result SIM7600_CMD_xxx
+ */
+void SIM7600::finishRaw(uint8_t result) {
+  SIM7600Command cmd;
+
+  strncpy(cmd.send, readCommand, SIM7600_CMD_MAXLEN - 1);
+  cmd.send[SIM7600_CMD_MAXLEN - 1] = 0;
+  cmd.flags = 0;
+  cmdReply[0] = 0;
+  recordStats(&cmd, result);
+  readCommand = 0;
+  readText = false;
+}
+
+/**
+ * @brief Completion callback used by the blocking wrappers
+ *
+ * @param result The transaction result
+ * @param reply The reply line
+ * @param ctx The SIM7600 object waiting for the reply
+ */
+void SIM7600::onSyncReply(uint8_t result, const char *reply, void *ctx) {
+  SIM7600 *sim = (SIM7600 *)ctx;
+  strcpy(sim->replybuffer, reply);
+  sim->syncResult = result;
+  sim->syncDone = true;
+}
+
+/**
+ * @brief Completion callback of a queued AT+CMGF=1, keeps the mode cache right
+ *
+ * @param result The transaction result
+ * @param reply The reply line
+ * @param ctx The SIM7600 object
+ */
+void SIM7600::onTextMode(uint8_t result, const char *reply, void *ctx) {
+  SIM7600 *sim = (SIM7600 *)ctx;
+  sim->modeCMGF = (result == SIM7600_CMD_OK) ? 1 : -1;
+}
+
+/********* COMMAND STATISTICS *****************************************/
+
+/**
+ * @brief Account for a finished transaction
+ *
+ * Constant time apart from the prefix lookup, cheap enough to stay enabled.
+ *
+ * @param cmd The transaction, still in the queue
+ * @param result SIM7600_CMD_xxx
+ */
+void SIM7600::recordStats(const SIM7600Command *cmd, uint8_t result) {
+  uint32_t us = micros() - cmdStartUs;
+  char prefix[SIM7600_STATS_PREFIX + 1];
+  uint8_t n = 0;
+  uint8_t i;
+
+  // "AT+CMGS=..." -> "CMGS", "ATE0" -> "E", SMS body -> ">"
+  if (cmd->flags & SIM7600_CMD_PAYLOAD) {
+    prefix[n++] = '>';
+  } else {
+    const char *p = cmd->send;
+    if ((p[0] == 'A') && (p[1] == 'T'))
+      p += 2;
+    if ((*p == '+') || (*p == '&'))
+      p++;
+    while ((n < SIM7600_STATS_PREFIX) && isalpha(p[n])) {
+      prefix[n] = p[n];
+      n++;
+    }
+    if (n == 0)
+      prefix[n++] = '-'; // plain "AT"
+  }
+  prefix[n] = 0;
+
+  for (i = 0; i < statsCount; i++) {
+    if (strcmp(stats[i].prefix, prefix) == 0)
+      break;
+  }
+  if (i == statsCount) {
+    if (statsCount < SIM7600_STATS_SLOTS) {
+      memset(&stats[i], 0, sizeof(stats[i]));
+      strcpy(stats[i].prefix, (statsCount == SIM7600_STATS_SLOTS - 1) ? "*" : prefix);
+      stats[i].min = 0xFFFFFFFF;
+      statsCount++;
+    } else {
+      i = SIM7600_STATS_SLOTS - 1;
+    }
+  }
+
+  SIM7600Stats *st = &stats[i];
+  if (result == SIM7600_CMD_TIMEOUT) {
+    st->timeouts++;
+    return;
+  }
+  // the blocking wrappers take any first line, ERROR included, as the reply
+  if ((result == SIM7600_CMD_ERROR) || (strcmp(cmdReply, "ERROR") == 0) || (strncmp(cmdReply, "+CME ERROR", 10) == 0) ||
+      (strncmp(cmdReply, "+CMS ERROR", 10) == 0))
+    st->errors++;
+  st->count++;
+  st->total += us;
+  if (us < st->min)
+    st->min = us;
+  if (us > st->max)
+    st->max = us;
+  uint8_t bucket = statsBucket(us);
+  if (st->histogram[bucket] < 0xFFFF)
+    st->histogram[bucket]++;
+}
+
+/**
+ * @brief Histogram bucket of a latency
+ *
+ * Each power of two is split in SIM7600_STATS_SUB linear buckets, so a
+ * bucket is never wider than 25% of its value.
+ *
+ * @param us The latency
+ * @return uint8_t The bucket
+ */
+uint8_t SIM7600::statsBucket(uint32_t us) {
+  if (us < SIM7600_STATS_SUB)
+    return us;
+  uint8_t exponent = 31 - __builtin_clz(us); // >= 2
+  uint16_t bucket = (exponent - 1) * SIM7600_STATS_SUB + ((us >> (exponent - 2)) & (SIM7600_STATS_SUB - 1));
+  return (bucket < SIM7600_STATS_BUCKETS) ? bucket : SIM7600_STATS_BUCKETS - 1;
+}
+
+/**
+ * @brief Highest latency counted in a bucket
+ *
+ * @param bucket The bucket
+ * @return uint32_t The latency in microseconds
+ */
+uint32_t SIM7600::statsBucketValue(uint8_t bucket) {
+  if (bucket < SIM7600_STATS_SUB)
+    return bucket;
+  uint8_t exponent = bucket / SIM7600_STATS_SUB + 1;
+  uint32_t sub = bucket % SIM7600_STATS_SUB;
+  return ((SIM7600_STATS_SUB + sub + 1) << (exponent - 2)) - 1;
+}
+
+/**
+ * @brief Estimate a latency percentile from the histogram
+ *
+ * @param stats The statistics of one prefix
+ * @param percent 50 for the median, 99...
+ * @return uint32_t The latency in microseconds, 0 without data
+ */
+uint32_t SIM7600::statsPercentile(const SIM7600Stats *stats, uint8_t percent) {
+  uint32_t total = 0;
+  uint32_t seen = 0;
+  uint8_t i;
+
+  for (i = 0; i < SIM7600_STATS_BUCKETS; i++)
+    total += stats->histogram[i];
+  if (total == 0)
+    return 0;
+
+  uint32_t rank = (total * percent + 99) / 100;
+  for (i = 0; i < SIM7600_STATS_BUCKETS; i++) {
+    seen += stats->histogram[i];
+    if (seen >= rank)
+      break;
+  }
+  // the bucket bound is never above what was actually seen
+  return min(statsBucketValue(i), stats->max);
+}
+
+/**
+ * @brief Copy the latency statistics, e.g. for an upload
+ *
+ * @param table Array to fill
+ * @param maxstats Size of the array
+ * @return uint8_t The number of prefixes copied
+ */
+uint8_t SIM7600::getStats(SIM7600Stats *table, uint8_t maxstats) {
+  uint8_t n = min(maxstats, statsCount);
+  memcpy(table, stats, n * sizeof(SIM7600Stats));
+  return n;
+}
+
+/**
+ * @brief Print the latency statistics, one line per command prefix
+ *
+ * @param out Where to print, e.g. Serial
+ */
+void SIM7600::printStats(Print &out) {
+  char line[128];
+
+  out.println(F("cmd      count  tmo  err    min   mean    p50    p90    p99    max (ms)"));
+  for (uint8_t i = 0; i < statsCount; i++) {
+    SIM7600Stats *st = &stats[i];
+    uint32_t mean = st->count ? st->total / st->count : 0;
+    snprintf(line, sizeof(line), "%-8s %5lu %4u %4u %6.1f %6.1f %6.1f %6.1f %6.1f %6.1f", st->prefix, (unsigned long)st->count,
+             st->timeouts, st->errors, st->count ? st->min / 1000.0 : 0.0, mean / 1000.0, statsPercentile(st, 50) / 1000.0,
+             statsPercentile(st, 90) / 1000.0, statsPercentile(st, 99) / 1000.0, st->max / 1000.0);
+    out.println(line);
+  }
+}
+
+/**
+ * @brief Forget the latency statistics
+ *
+ */
+void SIM7600::resetStats(void) { statsCount = 0; }
+
+/********* UNSOLICITED RESULT CODES *********************************/
+
+/**
+ * @brief Register a handler for an unsolicited result code
+ *
+ * Lines starting with prefix are kept aside when they arrive during a
+ * command or a flushInput() and handed to the handler by the next poll().
+ *
+ * @param prefix The start of the URC line, e.g. F("+CMTI:") or F("RING")
+ * @param handler The function to call
+ * @param ctx Passed back to the handler
+ * @return true: success, false: no room for another handler
+ */
+bool SIM7600::onURC(SIM7600FlashStringPtr prefix, SIM7600URCHandler handler, void *ctx) {
+  if (urcCount >= SIM7600_URC_HANDLERS)
+    return false;
+
+  urcHandlers[urcCount].prefix = prefix;
+  urcHandlers[urcCount].handler = handler;
+  urcHandlers[urcCount].ctx = ctx;
+  urcCount++;
+  return true;
+}
+
+/**
+ * @brief Get the number of URCs lost because the stash was full
+ *
+ * @return uint16_t The number of dropped URCs
+ */
+uint16_t SIM7600::getURCDropped(void) { return urcDropped; }
+
+/**
+ * @brief Check if a line is the reply of a command
+ *
+ * "+CMD: ..." answering "AT+CMD..." is a reply even if +CMD is also a URC.
+ *
+ * @param line The line to check
+ * @param send The command sent
+ * @return true: the line answers the command
+ */
+bool SIM7600::isOwnReply(const char *line, const char *send) {
+  if (strncmp(send, "AT+", 3) != 0)
+    return false;
+  uint8_t n = 1;
+  while (isalnum(send[2 + n]))
+    n++;
+  return (strncmp(line, send + 2, n) == 0) && (line[n] == ':');
+}
+
+/**
+ * @brief Check if a line belongs to the reply readline() is reading
+ *
+ * The header of readCommand and, when readText is set, the text line that
+ * follows it is part of the reply.
+ *
+ * @param line The line to check
+ * @return true: the line must not be taken for a URC
+ */
+bool SIM7600::isReplyLine(const char *line) {
+  if (readCommand == 0)
+    return false;
+  if (isOwnReply(line, readCommand))
+    return true;
+  return readText;
+}
+
+/**
+ * @brief Check if a line is a registered URC
+ *
+ * @param line The line to check
+ * @return true: a handler is registered for the line
+ */
+bool SIM7600::isURC(const char *line) {
+  for (uint8_t i = 0; i < urcCount; i++) {
+    if (strncmp(line, (prog_char *)urcHandlers[i].prefix, strlen((prog_char *)urcHandlers[i].prefix)) == 0)
+      return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Keep a URC until the next poll()
+ *
+ * @param line The URC line
+ * @return true: success, false: the stash is full
+ */
+bool SIM7600::stashURC(const char *line) {
+  if (urcStashed >= SIM7600_URC_STASH) {
+    urcDropped++;
+    return false;
+  }
+
+  char *slot = urcStash[(urcHead + urcStashed) % SIM7600_URC_STASH];
+  strncpy(slot, line, SIM7600_URC_MAXLEN - 1);
+  slot[SIM7600_URC_MAXLEN - 1] = 0;
+  urcStashed++;
+  return true;
+}
+
+/**
+ * @brief Hand every stashed URC to its handlers
+ *
+ */
+void SIM7600::dispatchURC(void) {
+  char line[SIM7600_URC_MAXLEN];
+
+  while (urcStashed) {
+    // copy first, handlers may run commands that stash more URCs
+    strcpy(line, urcStash[urcHead]);
+    urcHead = (urcHead + 1) % SIM7600_URC_STASH;
+    urcStashed--;
+
+    for (uint8_t i = 0; i < urcCount; i++) {
+      if (strncmp(line, (prog_char *)urcHandlers[i].prefix, strlen((prog_char *)urcHandlers[i].prefix)) == 0)
+        urcHandlers[i].handler(line, urcHandlers[i].ctx);
+    }
+  }
+}
+
+/********* HELPERS *********************************************/
+
+/**
+ * @brief Check if the received reply matches the expectation
+ *
+ * @param reply The expected reply
+ * @param timeout Read timeout
+ * @return true: success, false: failure
+ */
+bool SIM7600::expectReply(SIM7600FlashStringPtr reply, uint16_t timeout) {
+  readline(timeout);
+
+  DebugStream.print(F("\t<--- "));
+  DebugStream.println(replybuffer);
+
+  return (strcmp(replybuffer, (prog_char *)reply) == 0);
+}
+
+/********* LOW LEVEL *******************************************/
+
+/**
+ * @brief Serial data available
+ *
+ * @return int
+ */
+inline int SIM7600::available(void) { return mySerial->available(); } ///<
+/**
+ * @brief Serial write
+ *
+ * @param x
+ * @return size_t
+ */
+inline size_t SIM7600::write(uint8_t x) {
+  return mySerial->write(x);
+} ///<
+/**
+ * @brief Serial read
+ *
+ * @return int
+ */
+inline int SIM7600::read(void) { return mySerial->read(); } ///<
+/**
+ * @brief Serial peek
+ *
+ * @return int
+ */
+inline int SIM7600::peek(void) { return mySerial->peek(); } ///<
+/**
+ * @brief Flush the serial data
+ *
+ */
+inline void SIM7600::flush() { mySerial->flush(); } ///<
+/**
+ * @brief Read all available serial input to flush pending data.
+ *
+ * Registered URCs found in the pending data are stashed, not discarded.
+ *
+ */
+void SIM7600::flushInput() {
+  uint16_t timeoutloop = 0;
+  // the bytes belong to the queued transactions
+  if (cmdCount)
+    return;
+  rxlen = 0;
+  while (timeoutloop++ < 40) {
+    while (available()) {
+      // keep the URCs, drop the rest
+      if (assemble(read())) {
+        if (isURC(rxline))
+          stashURC(rxline);
+        rxlen = 0;
+      }
+      timeoutloop = 0; // If char was received reset the timer
+    }
+    delay(1);
+  }
+  cmdTail = false;
+  rxlen = 0;
+  rxline[0] = 0;
+}
+/**
+ * @brief Read directly into the reply buffer
+ *
+ * @param read_length The number of bytes to return
  * @return uint16_t The number of bytes read
  */
 uint16_t SIM7600::readRaw(uint16_t read_length) {
   uint16_t idx = 0;
+  bool lineStart = true;
 
   while (read_length && (idx < sizeof(replybuffer) - 1)) {
     if (mySerial->available()) {
-      replybuffer[idx] = mySerial->read();
+      char c = mySerial->read();
+      // NMEA sentences are not part of the reply
+      if (takeNMEA(c, lineStart))
+        continue;
+      lineStart = (c == '\n');
+      replybuffer[idx] = c;
       idx++;
       read_length--;
     }
@@ -1039,6 +2303,8 @@ uint16_t SIM7600::readRaw(uint16_t read_length) {
 /**
  * @brief Read a single line or up to 254 bytes
  *
+ * Registered URCs met while waiting for a single line are stashed.
+ *
  * @param timeout Reply timeout
  * @param multiline true: read the maximum amount. false: read up to the second
  * newline
@@ -1046,6 +2312,40 @@ uint16_t SIM7600::readRaw(uint16_t read_length) {
  */
 uint8_t SIM7600::readline(uint16_t timeout, bool multiline) {
   uint16_t replyidx = 0;
+  bool lineStart = true;
+
+  // the bytes belong to the queued transactions
+  if (cmdCount) {
+    replybuffer[0] = 0;
+    return 0;
+  }
+  // the caller reads the rest of the reply itself
+  cmdTail = false;
+
+  if (!multiline) {
+    uint32_t start = millis();
+    bool complete = false;
+    while (!complete) {
+      while (!complete && mySerial->available()) {
+        complete = assemble(mySerial->read());
+        // not the line we are waiting for
+        if (complete && !isReplyLine(rxline) && isURC(rxline)) {
+          stashURC(rxline);
+          rxlen = 0;
+          complete = false;
+        }
+      }
+      if (millis() - start >= timeout)
+        break;
+      yield();
+    }
+    // on timeout, return what was received so far
+    strcpy(replybuffer, rxline);
+    replyidx = rxlen;
+    rxlen = 0;
+    rxline[0] = 0;
+    return replyidx;
+  }
 
   while (timeout--) {
     if (replyidx >= 254) {
@@ -1053,19 +2353,18 @@ uint8_t SIM7600::readline(uint16_t timeout, bool multiline) {
       break;
     }
 
-    while (mySerial->available()) {
+    while (mySerial->available() && (replyidx < 254)) {
       char c = mySerial->read();
+      // NMEA sentences are not part of the reply
+      if (takeNMEA(c, lineStart))
+        continue;
       if (c == '\r')
         continue;
       if (c == 0xA) {
-        if (replyidx == 0) // the first 0x0A is ignored
+        if (lineStart) // empty lines, and the first 0x0A, are ignored
           continue;
-
-        if (!multiline) {
-          timeout = 0; // the second 0x0A is the end of the line
-          break;
-        }
       }
+      lineStart = (c == 0xA);
       replybuffer[replyidx] = c;
       // DebugStream.print(c, HEX); DebugStream.print("#"); DebugStream.println(c);
       replyidx++;
@@ -1088,19 +2387,7 @@ uint8_t SIM7600::readline(uint16_t timeout, bool multiline) {
  * @return uint8_t The response length
  */
 uint8_t SIM7600::getReply(char *send, uint16_t timeout) {
-  flushInput();
-
-  DebugStream.print(F("\t---> "));
-  DebugStream.println(send);
-
-  mySerial->println(send);
-
-  uint8_t l = readline(timeout);
-
-  DebugStream.print(F("\t<--- "));
-  DebugStream.println(replybuffer);
-
-  return l;
+  return transact(send, timeout);
 }
 
 /**
@@ -1111,19 +2398,7 @@ uint8_t SIM7600::getReply(char *send, uint16_t timeout) {
  * @return uint8_t The response length
  */
 uint8_t SIM7600::getReply(SIM7600FlashStringPtr send, uint16_t timeout) {
-  flushInput();
-
-  DebugStream.print(F("\t---> "));
-  DebugStream.println(send);
-
-  mySerial->println(send);
-
-  uint8_t l = readline(timeout);
-
-  DebugStream.print(F("\t<--- "));
-  DebugStream.println(replybuffer);
-
-  return l;
+  return transact((prog_char *)send, timeout);
 }
 
 // Send prefix, suffix, and newline. Return response (and also set replybuffer
@@ -1137,21 +2412,9 @@ uint8_t SIM7600::getReply(SIM7600FlashStringPtr send, uint16_t timeout) {
  * @return uint8_t The response length
  */
 uint8_t SIM7600::getReply(SIM7600FlashStringPtr prefix, char *suffix, uint16_t timeout) {
-  flushInput();
-
-  DebugStream.print(F("\t---> "));
-  DebugStream.print(prefix);
-  DebugStream.println(suffix);
-
-  mySerial->print(prefix);
-  mySerial->println(suffix);
-
-  uint8_t l = readline(timeout);
-
-  DebugStream.print(F("\t<--- "));
-  DebugStream.println(replybuffer);
-
-  return l;
+  char sendbuff[SIM7600_CMD_MAXLEN];
+  snprintf(sendbuff, sizeof(sendbuff), "%s%s", (prog_char *)prefix, suffix);
+  return transact(sendbuff, timeout);
 }
 
 // Send prefix, suffix, and newline. Return response (and also set replybuffer
@@ -1166,21 +2429,9 @@ uint8_t SIM7600::getReply(SIM7600FlashStringPtr prefix, char *suffix, uint16_t t
  */
 uint8_t SIM7600::getReply(SIM7600FlashStringPtr prefix, int32_t suffix,
                                 uint16_t timeout) {
-  flushInput();
-
-  DebugStream.print(F("\t---> "));
-  DebugStream.print(prefix);
-  DebugStream.println(suffix, DEC);
-
-  mySerial->print(prefix);
-  mySerial->println(suffix, DEC);
-
-  uint8_t l = readline(timeout);
-
-  DebugStream.print(F("\t<--- "));
-  DebugStream.println(replybuffer);
-
-  return l;
+  char sendbuff[SIM7600_CMD_MAXLEN];
+  snprintf(sendbuff, sizeof(sendbuff), "%s%ld", (prog_char *)prefix, (long)suffix);
+  return transact(sendbuff, timeout);
 }
 
 // Send prefix, suffix, suffix2, and newline. Return response (and also set
@@ -1195,25 +2446,9 @@ uint8_t SIM7600::getReply(SIM7600FlashStringPtr prefix, int32_t suffix,
  * @return uint8_t The response length
  */
 uint8_t SIM7600::getReply(SIM7600FlashStringPtr prefix, int32_t suffix1, int32_t suffix2, uint16_t timeout) {
-  flushInput();
-
-  DebugStream.print(F("\t---> "));
-  DebugStream.print(prefix);
-  DebugStream.print(suffix1, DEC);
-  DebugStream.print(',');
-  DebugStream.println(suffix2, DEC);
-
-  mySerial->print(prefix);
-  mySerial->print(suffix1);
-  mySerial->print(',');
-  mySerial->println(suffix2, DEC);
-
-  uint8_t l = readline(timeout);
-
-  DebugStream.print(F("\t<--- "));
-  DebugStream.println(replybuffer);
-
-  return l;
+  char sendbuff[SIM7600_CMD_MAXLEN];
+  snprintf(sendbuff, sizeof(sendbuff), "%s%ld,%ld", (prog_char *)prefix, (long)suffix1, (long)suffix2);
+  return transact(sendbuff, timeout);
 }
 
 // Send prefix, ", suffix, ", and newline. Return response (and also set
@@ -1227,25 +2462,9 @@ uint8_t SIM7600::getReply(SIM7600FlashStringPtr prefix, int32_t suffix1, int32_t
  * @return uint8_t The response length
  */
 uint8_t SIM7600::getReplyQuoted(SIM7600FlashStringPtr prefix, SIM7600FlashStringPtr suffix, uint16_t timeout) {
-  flushInput();
-
-  DebugStream.print(F("\t---> "));
-  DebugStream.print(prefix);
-  DebugStream.print('"');
-  DebugStream.print(suffix);
-  DebugStream.println('"');
-
-  mySerial->print(prefix);
-  mySerial->print('"');
-  mySerial->print(suffix);
-  mySerial->println('"');
-
-  uint8_t l = readline(timeout);
-
-  DebugStream.print(F("\t<--- "));
-  DebugStream.println(replybuffer);
-
-  return l;
+  char sendbuff[SIM7600_CMD_MAXLEN];
+  snprintf(sendbuff, sizeof(sendbuff), "%s\"%s\"", (prog_char *)prefix, (prog_char *)suffix);
+  return transact(sendbuff, timeout);
 }
 
 /**
@@ -1364,6 +2583,143 @@ bool SIM7600::sendCheckReplyQuoted(SIM7600FlashStringPtr prefix, SIM7600FlashStr
   return (strcmp(replybuffer, (prog_char *)reply) == 0);
 }
 
+/**
+ * @brief Split the reply into fields without copying or modifying it
+ *
+ * The reply buffer is scanned once from the end of toreply, each field is
+ * returned as a pointer into the buffer and a length.
+ *
+ * @param toreply Pointer to a buffer with the reply prefix the fields follow
+ * @param divider The divider character
+ * @param fields Array to fill with the fields
+ * @param maxfields Size of the fields array, the scan stops once it is full
+ * @return uint8_t The number of fields found, 0 if toreply is not in the reply
+ */
+uint8_t SIM7600::tokenize(SIM7600FlashStringPtr toreply, char divider, SIM7600Field *fields, uint8_t maxfields) {
+  const char *p = strstr(replybuffer, (prog_char *)toreply);
+  uint8_t count = 0;
+
+  if (p == 0)
+    return 0;
+  p += strlen((prog_char *)toreply);
+
+  while (count < maxfields) {
+    const char *end = p;
+    while (*end && (*end != divider))
+      end++;
+    fields[count].p = p;
+    fields[count].len = end - p;
+    count++;
+    if (*end == 0)
+      break;
+    p = end + 1;
+  }
+  return count;
+}
+
+/**
+ * @brief Convert a field to an integer
+ *
+ * Leading spaces and a sign are accepted, conversion stops at the first
+ * character that is not a digit.
+ *
+ * @param field The field to convert
+ * @param v Pointer to the value
+ * @return true: success, false: no digit in the field
+ */
+bool SIM7600::fieldToInt(SIM7600Field field, int32_t *v) {
+  const char *p = field.p;
+  const char *end = field.p + field.len;
+  bool negative = false;
+  int32_t value = 0;
+
+  while ((p < end) && (*p == ' '))
+    p++;
+  if ((p < end) && ((*p == '-') || (*p == '+')))
+    negative = (*p++ == '-');
+  if ((p == end) || (*p < '0') || (*p > '9'))
+    return false;
+  while ((p < end) && (*p >= '0') && (*p <= '9'))
+    value = value * 10 + (*p++ - '0');
+
+  *v = negative ? -value : value;
+  return true;
+}
+
+/**
+ * @brief Convert a decimal field to a fixed-point integer
+ *
+ * "12.5" with 3 decimals gives 12500. Extra decimals are truncated, the
+ * result must fit in 32 bits.
+ *
+ * @param field The field to convert
+ * @param decimals Number of decimals kept in the result
+ * @param v Pointer to the value, scaled by 10^decimals
+ * @return true: success, false: no digit in the field
+ */
+bool SIM7600::fieldToFixed(SIM7600Field field, uint8_t decimals, int32_t *v) {
+  const char *p = field.p;
+  const char *end = field.p + field.len;
+  bool negative = false;
+  bool digits = false;
+  int32_t value = 0;
+
+  while ((p < end) && (*p == ' '))
+    p++;
+  if ((p < end) && ((*p == '-') || (*p == '+')))
+    negative = (*p++ == '-');
+  while ((p < end) && (*p >= '0') && (*p <= '9')) {
+    value = value * 10 + (*p++ - '0');
+    digits = true;
+  }
+  if ((p < end) && (*p == '.'))
+    p++;
+  for (uint8_t i = 0; i < decimals; i++) {
+    value *= 10;
+    if ((p < end) && (*p >= '0') && (*p <= '9')) {
+      value += *p++ - '0';
+      digits = true;
+    }
+  }
+  if (!digits)
+    return false;
+
+  *v = negative ? -value : value;
+  return true;
+}
+
+/**
+ * @brief Convert an NMEA (d)ddmm.mmmmmm field to micro-degrees
+ *
+ * @param value The coordinate field
+ * @param hemisphere The N/S or E/W field
+ * @param v Pointer to the value, negative south and west
+ * @return true: success, false: empty field
+ */
+bool SIM7600::fieldToMicroDegrees(SIM7600Field value, SIM7600Field hemisphere, int32_t *v) {
+  int32_t ddmm;
+  int32_t fraction = 0;
+  uint8_t dot = 0;
+
+  if (!fieldToInt(value, &ddmm))
+    return false;
+  while ((dot < value.len) && (value.p[dot] != '.'))
+    dot++;
+  if (dot < value.len) {
+    SIM7600Field decimals = {value.p + dot, (uint8_t)(value.len - dot)};
+    fieldToFixed(decimals, 6, &fraction);
+  }
+
+  // minutes scaled by 10^6, then rounded to micro-degrees
+  int32_t minutes = (ddmm % 100) * 1000000 + fraction;
+  int32_t degrees = (ddmm / 100) * 1000000 + (minutes + 30) / 60;
+
+  if ((hemisphere.len > 0) && ((hemisphere.p[0] == 'S') || (hemisphere.p[0] == 'W')))
+    degrees = -degrees;
+  *v = degrees;
+  return true;
+}
+
 /**
  * @brief Parse a string in the response fields using a designated separator
  * and copy the value at the specified index in to the supplied buffer.
@@ -1375,20 +2731,14 @@ bool SIM7600::sendCheckReplyQuoted(SIM7600FlashStringPtr prefix, SIM7600FlashStr
  * @return true: success, false: failure
  */
 bool SIM7600::parseReply(SIM7600FlashStringPtr toreply, uint16_t *v, char divider, uint8_t index) {
-  char *p = strstr(replybuffer, (prog_char *)toreply);
-  if (p == 0)
+  SIM7600Field fields[SIM7600_MAX_FIELDS];
+  int32_t value = 0;
+
+  if ((index >= SIM7600_MAX_FIELDS) || (tokenize(toreply, divider, fields, index + 1) <= index))
     return false;
-  p += strlen((prog_char *)toreply);
-  // DebugStream.println(p);
-  for (uint8_t i = 0; i < index; i++) {
-    // increment dividers
-    p = strchr(p, divider);
-    if (!p)
-      return false;
-    p++;
-    // DebugStream.println(p);
-  }
-  *v = atoi(p);
+  // an empty field reads as 0
+  fieldToInt(fields[index], &value);
+  *v = value;
 
   return true;
 }
@@ -1405,27 +2755,13 @@ bool SIM7600::parseReply(SIM7600FlashStringPtr toreply, uint16_t *v, char divide
  * @return true: success, false: failure
  */
 bool SIM7600::parseReply(SIM7600FlashStringPtr toreply, char *v, char divider, uint8_t index) {
-  uint8_t i = 0;
-  char *p = strstr(replybuffer, (prog_char *)toreply);
-  if (p == 0)
-    return false;
-  p += strlen((prog_char *)toreply);
+  SIM7600Field fields[SIM7600_MAX_FIELDS];
 
-  for (i = 0; i < index; i++) {
-    // increment dividers
-    p = strchr(p, divider);
-    if (!p)
-      return false;
-    p++;
-  }
-
-  for (i = 0; i < strlen(p); i++) {
-    if (p[i] == divider)
-      break;
-    v[i] = p[i];
-  }
+  if ((index >= SIM7600_MAX_FIELDS) || (tokenize(toreply, divider, fields, index + 1) <= index))
+    return false;
 
-  v[i] = '\0';
+  memcpy(v, fields[index].p, fields[index].len);
+  v[fields[index].len] = '\0';
 
   return true;
 }
@@ -1446,31 +2782,17 @@ bool SIM7600::parseReply(SIM7600FlashStringPtr toreply, char *v, char divider, u
  * @return true: success, false: failure
  */
 bool SIM7600::parseReplyQuoted(SIM7600FlashStringPtr toreply, char *v, int maxlen, char divider, uint8_t index) {
-  uint8_t i = 0, j;
-  // Verify response starts with toreply.
-  char *p = strstr(replybuffer, (prog_char *)toreply);
-  if (p == 0)
+  SIM7600Field fields[SIM7600_MAX_FIELDS];
+  int j = 0;
+
+  // Verify response starts with toreply and find the field.
+  if ((index >= SIM7600_MAX_FIELDS) || (tokenize(toreply, divider, fields, index + 1) <= index))
     return false;
-  p += strlen((prog_char *)toreply);
 
-  // Find location of desired response field.
-  for (i = 0; i < index; i++) {
-    // increment dividers
-    p = strchr(p, divider);
-    if (!p)
-      return false;
-    p++;
-  }
-
-  // Copy characters from response field into result string.
-  for (i = 0, j = 0; j < maxlen && i < strlen(p); ++i) {
-    // Stop if a divier is found.
-    if (p[i] == divider)
-      break;
-    // Skip any quotation marks.
-    else if (p[i] == '"')
-      continue;
-    v[j++] = p[i];
+  // Copy characters from response field into result string, skipping any quotation marks.
+  for (uint8_t i = 0; (i < fields[index].len) && (j < maxlen); i++) {
+    if (fields[index].p[i] != '"')
+      v[j++] = fields[index].p[i];
   }
 
   // Add a null terminator if result string buffer was not filled.
@@ -1535,20 +2857,12 @@ bool SIM7600::sendParseReply(SIM7600FlashStringPtr tosend, SIM7600FlashStringPtr
  * @return true: success, false: failure
  */
 bool SIM7600::parseReply(SIM7600FlashStringPtr toreply, float *f, char divider, uint8_t index) {
-  char *p = strstr(replybuffer, (prog_char *)toreply);
-  if (p == 0)
+  SIM7600Field fields[SIM7600_MAX_FIELDS];
+
+  if ((index >= SIM7600_MAX_FIELDS) || (tokenize(toreply, divider, fields, index + 1) <= index))
     return false;
-  p += strlen((prog_char *)toreply);
-  // DebugStream.println(p);
-  for (uint8_t i = 0; i < index; i++) {
-    // increment dividers
-    p = strchr(p, divider);
-    if (!p)
-      return false;
-    p++;
-    // DebugStream.println(p);
-  }
-  *f = atof(p);
+  // strtod stops at the divider, no copy needed
+  *f = strtod(fields[index].p, 0);
 
   return true;
 }
@@ -23,11 +23,130 @@
 
 #define DebugStream Serial
 
+// Asynchronous command engine
+#define SIM7600_CMD_QUEUE_SIZE 8   ///< Number of AT transactions that can be queued
+#define SIM7600_TAIL_MS 100        ///< Longest wait for the final OK of a reply taken on its first line
+#define SIM7600_CMD_MAXLEN 180     ///< Longest command (or SMS payload) that can be queued
+
+// Unsolicited result codes
+#define SIM7600_URC_HANDLERS 10    ///< Number of URC handlers that can be registered
+#define SIM7600_URC_STASH 8        ///< Number of URCs kept until the next poll()
+#define SIM7600_URC_MAXLEN 80      ///< Longest URC line kept
+
+// Reply tokenizer
+#define SIM7600_MAX_FIELDS 16      ///< Most fields parsed from a single reply
+
+// Command latency statistics
+#define SIM7600_STATS_SLOTS 16     ///< Command prefixes tracked, the last one collects the rest
+#define SIM7600_STATS_PREFIX 8     ///< Longest prefix kept, "CGPSINFO" fits
+#define SIM7600_STATS_SUB 4        ///< Linear sub-buckets per power of two
+#define SIM7600_STATS_BUCKETS 104  ///< Histogram buckets, latencies up to 2^26 us (67 s)
+
+// NMEA decoder
+#define SIM7600_NMEA_TERMLEN 16    ///< Longest NMEA field kept by the decoder
+#define SIM7600_NMEA_MAXLEN 82     ///< Longest NMEA sentence, a longer one lost its CR
+
+// Serial link
+#define SIM7600_DEFAULT_BAUD 115200 ///< Factory rate of the module
+#define SIM7600_LINK_CHECKS 8       ///< AT round trips a new rate must pass
+#define SIM7600_BOOT_MS 7000        ///< Time the module takes to boot after a reset
+
+// SMS inbox
+#define SIM7600_SMS_SENDER_LEN 20  ///< Longest sender number kept by listSMS()
+#define SIM7600_SMS_TEXT_LEN 160   ///< Longest message text kept by listSMS()
+
+// Result of a queued AT transaction, passed to its callback
+#define SIM7600_CMD_OK 0
+#define SIM7600_CMD_ERROR 1
+#define SIM7600_CMD_TIMEOUT 2
+#define SIM7600_CMD_ABORTED 3
+#define SIM7600_CMD_BUSY 4         ///< Blocking wrappers only: transactions were queued, nothing was sent
+
+// Transaction flags
+#define SIM7600_CMD_CHAINED 0x01   ///< Abort if the previous transaction failed
+#define SIM7600_CMD_PAYLOAD 0x02   ///< Raw text terminated by Ctrl-Z (SMS body)
+
 typedef Stream SIM7600StreamType;
 typedef const __FlashStringHelper *SIM7600FlashStringPtr;
 
 #define prog_char char PROGMEM
 
+/**
+ * Completion callback of a queued AT transaction. reply holds the line that
+ * matched (or the last line received on failure) and is only valid during the call.
+ */
+typedef void (*SIM7600Callback)(uint8_t result, const char *reply, void *ctx);
+
+/**
+ * Handler of an unsolicited result code. urc holds the whole line and is only
+ * valid during the call.
+ */
+typedef void (*SIM7600URCHandler)(const char *urc, void *ctx);
+
+/** One registered URC handler */
+typedef struct {
+  SIM7600FlashStringPtr prefix;   ///< Start of the lines routed to the handler
+  SIM7600URCHandler handler;      ///< Called from poll()
+  void *ctx;                      ///< Passed back to the handler
+} SIM7600URC;
+
+/** A field of a modem reply, referenced in place in the reply buffer */
+typedef struct {
+  const char *p;   ///< First character of the field, not null terminated
+  uint8_t len;     ///< Number of characters up to the divider
+} SIM7600Field;
+
+/** GNSS fix in fixed point, bit-exact and free of floating point */
+typedef struct {
+  int32_t lat;       ///< Latitude in micro-degrees, negative south
+  int32_t lon;       ///< Longitude in micro-degrees, negative west
+  int32_t altitude;  ///< Altitude above sea level in millimetres
+  time_t datetime;   ///< UTC date and time of the fix
+} SIM7600Position;
+
+/** GNSS state decoded from the NMEA stream, updated as sentences arrive */
+typedef struct {
+  SIM7600Position pos;   ///< Last position and UTC time, altitude from GGA
+  uint32_t updated;      ///< millis() of the last valid RMC
+  uint32_t ttff;         ///< Time to first fix in ms, 0 until the first fix
+  uint32_t sentences;    ///< RMC, GGA and GSA sentences decoded
+  uint16_t errors;       ///< Sentences dropped on a bad checksum or cut short
+  uint16_t hdop;         ///< Horizontal dilution of precision x100 (GGA)
+  uint8_t quality;       ///< GGA fix quality: 0 none, 1 GPS, 2 DGPS...
+  uint8_t fixType;       ///< GSA fix type: 1 none, 2 2D, 3 3D
+  uint8_t satellites;    ///< Satellites used (GGA)
+  bool valid;            ///< RMC status is A
+} SIM7600Fix;
+
+/** Latency statistics of one AT command prefix, times in microseconds */
+typedef struct {
+  char prefix[SIM7600_STATS_PREFIX + 1]; ///< "CMGS", "CSQ", "E" for ATE0...
+  uint32_t count;        ///< Transactions answered, OK or ERROR
+  uint16_t timeouts;     ///< Transactions that timed out
+  uint16_t errors;       ///< Transactions answered ERROR
+  uint32_t min;          ///< Fastest answer
+  uint32_t max;          ///< Slowest answer
+  uint64_t total;        ///< Sum of the answer times, for the mean
+  uint16_t histogram[SIM7600_STATS_BUCKETS]; ///< Log-linear histogram, see statsBucket()
+} SIM7600Stats;
+
+/** One stored SMS, as listed by AT+CMGL */
+typedef struct {
+  uint8_t index;                          ///< Storage slot
+  char sender[SIM7600_SMS_SENDER_LEN + 1]; ///< Sender number
+  char text[SIM7600_SMS_TEXT_LEN + 1];     ///< Message text
+} SIM7600SMS;
+
+/** One queued AT transaction */
+typedef struct {
+  char send[SIM7600_CMD_MAXLEN];  ///< Command line or payload
+  SIM7600FlashStringPtr expect;   ///< Expected reply prefix, 0 to complete on the first line
+  uint16_t timeout;               ///< Timeout in ms from the moment the command is sent
+  uint8_t flags;                  ///< SIM7600_CMD_xxx flags
+  SIM7600Callback callback;       ///< Called once the transaction is done, may be 0
+  void *ctx;                      ///< Passed back to the callback
+} SIM7600Command;
+
 /** Object that controls and keeps state for the SIM7600 module. */
 class SIM7600 : public SIM7600StreamType {
 public:
@@ -40,7 +159,16 @@ public:
   int peek(void);
   void flush();
 
-  bool setBaudrate(uint16_t baud);
+  bool setBaudrate(uint32_t baud);
+  uint32_t negotiateBaudrate(HardwareSerial &port, uint32_t maxbaud);
+  uint32_t probeBaudrate(HardwareSerial &port);
+
+  // Modem configuration, only sent when it differs from the cached state
+  bool setTextMode(bool text);
+  bool setSMSHeaders(bool show);
+  bool setSMSRouting(uint8_t mode, uint8_t mt);
+  void invalidateModes(void);
+  bool wasReset(void);
 
   // RTC
   bool enableRTC(uint8_t mode);
@@ -61,7 +189,10 @@ public:
   int8_t getNumSMS(void);
   bool readSMS(uint8_t message_index, char *smsbuff, uint16_t max, uint16_t *readsize);
   bool sendSMS(char *smsaddr, char *smsmsg);
+  bool sendSMSAsync(char *smsaddr, char *smsmsg, SIM7600Callback callback = 0, void *ctx = 0);
   bool deleteSMS(uint8_t message_index);
+  int8_t listSMS(SIM7600SMS *inbox, uint8_t maxsms, uint8_t *total = 0);
+  bool deleteReadSMS(void);
   bool getSMSSender(uint8_t message_index, char *sender, int senderlen);
   bool sendUSSD(char *ussdmsg, char *ussdbuff, uint16_t maxlen, uint16_t *readlen);
 
@@ -74,8 +205,12 @@ public:
   bool enableGPS(bool onoff);
   int8_t GPSstatus(void);
   uint8_t getGPS(uint8_t arg, char *buffer, uint8_t maxbuff);
+  bool getGPS(SIM7600Position *pos);
   bool getGPS(float *lat, float *lon, time_t *datetime = 0, float *altitude = 0);
+  static time_t calendarToEpoch(uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second);
   bool enableGPSNMEA(uint8_t enable_value);
+  bool reportNMEA(uint8_t seconds);
+  bool getFix(SIM7600Fix *fix);
 
   // Phone calls
   bool callPhone(char *phonenum);
@@ -85,6 +220,23 @@ public:
   bool callerIdNotification(bool enable, uint8_t interrupt = 0);
   bool incomingCallNumber(char *phonenum);
 
+  // Asynchronous command engine
+  bool queueCommand(const char *send, SIM7600FlashStringPtr expect, uint16_t timeout = DEFAULT_TIMEOUT_MS,
+                    SIM7600Callback callback = 0, void *ctx = 0, uint8_t flags = 0);
+  void poll(void);
+  bool busy(void);
+  uint8_t queueSpace(void);
+
+  // Command latency statistics
+  uint8_t getStats(SIM7600Stats *table, uint8_t maxstats);
+  void printStats(Print &out);
+  void resetStats(void);
+  static uint32_t statsPercentile(const SIM7600Stats *stats, uint8_t percent);
+
+  // Unsolicited result codes
+  bool onURC(SIM7600FlashStringPtr prefix, SIM7600URCHandler handler, void *ctx = 0);
+  uint16_t getURCDropped(void);
+
   // Helper functions to verify responses.
   bool expectReply(SIM7600FlashStringPtr reply, uint16_t timeout = 10000);
   bool sendCheckReply(char *send, char *reply, uint16_t timeout = DEFAULT_TIMEOUT_MS);
@@ -96,6 +248,85 @@ protected:
   char replybuffer[255];  ///< buffer for holding replies from the module
   SIM7600FlashStringPtr ok_reply;    ///< OK reply for successful requests
 
+  int8_t modeCMGF;         ///< Cached AT+CMGF, -1 when unknown
+  int8_t modeCSDH;         ///< Cached AT+CSDH, -1 when unknown
+  int8_t modeCNMI;         ///< Cached AT+CNMI <mode>, -1 when unknown
+  int8_t modeCNMIMt;       ///< Cached AT+CNMI <mt>, -1 when unknown
+  int8_t modeGPS;          ///< Cached AT+CGPS state, -1 when unknown
+  uint32_t modeBaud;       ///< Cached AT+IPREX rate, 0 when unknown
+  uint32_t linkBaud;       ///< Rate the host port runs at, 0 when unknown
+  uint8_t probeStep;       ///< Next rate tried by probeBaudrate()
+  uint32_t probeReset;     ///< millis() of the restart asked by probeBaudrate(), 0 when none
+  int16_t modeNMEA;        ///< Cached AT+CGPSINFOCFG period, -1 when unknown
+  bool modemReset;         ///< "RDY" seen since the last wasReset()
+
+  SIM7600Command cmdQueue[SIM7600_CMD_QUEUE_SIZE]; ///< Pending AT transactions
+  uint8_t cmdHead;         ///< Index of the oldest transaction
+  uint8_t cmdCount;        ///< Number of queued transactions
+  bool cmdActive;          ///< true when the head transaction has been sent
+  bool cmdMatched;         ///< Expected reply seen for the active transaction
+  bool cmdGotOK;           ///< Final OK seen for the active transaction
+  bool cmdLastFailed;      ///< Result of the last finished transaction, for chaining
+  bool cmdTail;            ///< The last reply was taken on its first line, its final result is still to come
+  uint32_t cmdStart;       ///< millis() when the active transaction was sent
+  uint32_t cmdStartUs;     ///< micros() when the active transaction was sent
+  char cmdReply[255];      ///< Line that matched the active transaction
+  char rxline[255];        ///< Line being assembled from the UART
+  uint8_t rxlen;           ///< Length of rxline
+  SIM7600URC urcHandlers[SIM7600_URC_HANDLERS];         ///< Registered URC handlers
+  uint8_t urcCount;        ///< Number of registered URC handlers
+  char urcStash[SIM7600_URC_STASH][SIM7600_URC_MAXLEN]; ///< URCs waiting for dispatch
+  uint8_t urcHead;         ///< Index of the oldest stashed URC
+  uint8_t urcStashed;      ///< Number of stashed URCs
+  uint16_t urcDropped;     ///< URCs lost because the stash was full
+  const char *readCommand; ///< Blocking command whose reply readline() is reading, 0 when none
+  bool readText;           ///< The next line is the text after its header, e.g. an SMS body
+  bool nmeaLine;           ///< A '$' sentence is being received
+  bool nmeaInChecksum;     ///< The '*' of the sentence has been seen
+  uint8_t nmeaSentence;    ///< Sentence being decoded, NMEA_xxx
+  uint8_t nmeaTermNum;     ///< Index of the field being received
+  uint8_t nmeaTermLen;     ///< Length of nmeaTerm
+  uint8_t nmeaParity;      ///< XOR of the characters between '$' and '*'
+  uint8_t nmeaLength;      ///< Characters of the sentence received so far
+  char nmeaTerm[SIM7600_NMEA_TERMLEN]; ///< Field being received
+  SIM7600Fix nmeaNew;      ///< Values of the sentence being decoded
+  uint8_t nmeaDate[3];     ///< Day, month, year of the sentence being decoded
+  int32_t nmeaTime;        ///< Seconds since midnight of the sentence being decoded
+  SIM7600Fix nmeaFix;      ///< Last decoded state
+  uint32_t nmeaStart;      ///< millis() when NMEA reporting was enabled, for the TTFF
+  SIM7600Stats stats[SIM7600_STATS_SLOTS]; ///< Latency statistics per command prefix
+  uint8_t statsCount;      ///< Number of prefixes in use
+  bool syncDone;           ///< Completion flag for the blocking wrappers
+  uint8_t syncResult;      ///< Result handed to the blocking wrappers
+
+  bool assemble(char c);
+  void process(void);
+  void handleLine(void);
+  static bool isOwnReply(const char *line, const char *send);
+  bool isReplyLine(const char *line);
+  bool isURC(const char *line);
+  bool stashURC(const char *line);
+  void dispatchURC(void);
+  bool takeNMEA(char c, bool lineStart);
+  bool encodeNMEA(char c);
+  void decodeNMEATerm(void);
+  void commitNMEA(void);
+  void startCommand(void);
+  void finishCommand(uint8_t result);
+  bool linkIdle(void);
+  static bool isFinal(const char *line);
+  void recordStats(const SIM7600Command *cmd, uint8_t result);
+  static uint8_t statsBucket(uint32_t us);
+  static uint32_t statsBucketValue(uint8_t bucket);
+  uint8_t transact(const char *send, uint16_t timeout);
+  void startRaw(const char *send);
+  void finishRaw(uint8_t result);
+  static void onSyncReply(uint8_t result, const char *reply, void *ctx);
+  static void onTextMode(uint8_t result, const char *reply, void *ctx);
+
+  bool checkLink(uint8_t checks);
+  void switchBaudrate(HardwareSerial &port, uint32_t baud);
+
   void flushInput();
   uint16_t readRaw(uint16_t read_length);
   uint8_t readline(uint16_t timeout = DEFAULT_TIMEOUT_MS, bool multiline = false);
@@ -112,6 +343,11 @@ protected:
   bool sendCheckReply(SIM7600FlashStringPtr prefix, int32_t suffix, int32_t suffix2, SIM7600FlashStringPtr reply, uint16_t timeout = DEFAULT_TIMEOUT_MS);
   bool sendCheckReplyQuoted(SIM7600FlashStringPtr prefix, SIM7600FlashStringPtr suffix, SIM7600FlashStringPtr reply, uint16_t timeout = DEFAULT_TIMEOUT_MS);
 
+  uint8_t tokenize(SIM7600FlashStringPtr toreply, char divider, SIM7600Field *fields, uint8_t maxfields);
+  static bool fieldToInt(SIM7600Field field, int32_t *v);
+  static bool fieldToFixed(SIM7600Field field, uint8_t decimals, int32_t *v);
+  static bool fieldToMicroDegrees(SIM7600Field value, SIM7600Field hemisphere, int32_t *v);
+
   bool parseReply(SIM7600FlashStringPtr toreply, uint16_t *v, char divider = ',', uint8_t index = 0);
   bool parseReply(SIM7600FlashStringPtr toreply, char *v, char divider = ',', uint8_t index = 0);
   bool parseReply(SIM7600FlashStringPtr toreply, float *f, char divider, uint8_t index);
@@ -10,6 +10,8 @@
 #include <TimeLib.h>
 #include <ILI9341_t3n.h>
 
+extern "C" const unsigned char glcdfont[];
+
 #define NUMBER_OF_STRINGS1    29
 #define STRING_LENGTH1        40
 
@@ -21,301 +23,1093 @@ typedef struct {
   uint16_t color;
 }Console;
 
+// ILI9341_t3n with the vertical scrolling commands
+class ScrollTFT : public ILI9341_t3n {
+public:
+  ScrollTFT(uint8_t cs, uint8_t dc) : ILI9341_t3n(cs, dc) {}
+  // Fixed top area, scrolled area and fixed bottom area, in lines
+  void setScrollArea(uint16_t top, uint16_t height, uint16_t bottom) {
+    beginSPITransaction(_SPI_CLOCK);
+    writecommand_cont(ILI9341_VSCRDEF);
+    writedata16_cont(top);
+    writedata16_cont(height);
+    writedata16_last(bottom);
+    endSPITransaction();
+  }
+  // A frame of rectangles keeps the bus until endFrame()
+  void beginFrame() {
+    beginSPITransaction(_SPI_CLOCK);
+  }
+  void endFrame() {
+    endSPITransaction();
+  }
+  // Address window of a rectangle, its pixels follow as data
+  void beginWindow(int16_t x, int16_t y, int16_t w, int16_t h) {
+    setAddr(x, y, x + w - 1, y + h - 1);
+    writecommand_last(ILI9341_RAMWR);
+    maybeUpdateTCR(_tcr_dc_not_assert | LPSPI_TCR_FRAMESZ(7));
+  }
+  // Bytes of the window by DMA, event is triggered once they are sent
+  void sendBytes(void *bytes, size_t count, EventResponder &event) {
+    _pspi->transfer(bytes, nullptr, count, event);
+  }
+};
+
 // Use hardware SPI for LCD
-ILI9341_t3n tft = ILI9341_t3n(TFT_CS, TFT_DC);
+ScrollTFT tft = ScrollTFT(TFT_CS, TFT_DC);
+
+#if DISPLAY_BPP == 16
+// Drawing goes to the RGB565 framebuffer of the driver
+typedef uint16_t Pixel;
+ScrollTFT &gfx = tft;
+
+static inline Pixel pixelOf(uint16_t color) { return color; }
+
+static inline void writePixel(int16_t x, int16_t y, Pixel pixel) {
+  tft.getFrameBuffer()[y * ILI9341_TFTWIDTH + x] = pixel;
+}
+
+static inline void writeSpan(int16_t x, int16_t y, const Pixel *src, int16_t count) {
+  memcpy(tft.getFrameBuffer() + y * ILI9341_TFTWIDTH + x, src, count * 2);
+}
+#else
+// Framebuffer of palette indexes, DISPLAY_BPP bits per pixel, expanded to RGB565
+// through the palette when a band of it is staged, see stageRows()
+#define PALETTE_SIZE          (1 << DISPLAY_BPP)
+
+typedef uint8_t Pixel;
+DMAMEM uint8_t indexedPixels[ILI9341_TFTWIDTH * ILI9341_TFTHEIGHT * DISPLAY_BPP / 8];
+
+// Draws into the indexed framebuffer like ILI9341_t3n draws into its own one
+class IndexedFB : public Print {
+public:
+  uint8_t *pixels = indexedPixels;
+  uint16_t palette[PALETTE_SIZE];
+  uint16_t paletteCount = 0;
+
+  int16_t width() { return ILI9341_TFTWIDTH; }
+  int16_t height() { return ILI9341_TFTHEIGHT; }
+
+  // Palette index of a color, added the first time it is used
+  // Once the palette is full, the nearest color is used
+  uint8_t colorIndex(uint16_t color) {
+    uint16_t i;
+    uint8_t best = 0;
+    int32_t bestDistance = 0x7FFFFFFF;
+    for (i = 0; i < paletteCount; i++) {
+      if (palette[i] == color) return i;
+    }
+    if (paletteCount < PALETTE_SIZE) {
+      palette[paletteCount] = color;
+      return paletteCount++;
+    }
+    for (i = 0; i < PALETTE_SIZE; i++) {
+      // Red and blue have 5 bits, green 6 bits
+      int32_t r = 2 * (((palette[i] >> 11) & 0x1F) - ((color >> 11) & 0x1F));
+      int32_t g = ((palette[i] >> 5) & 0x3F) - ((color >> 5) & 0x3F);
+      int32_t b = 2 * ((palette[i] & 0x1F) - (color & 0x1F));
+      int32_t distance = r * r + g * g + b * b;
+      if (distance < bestDistance) {
+        bestDistance = distance;
+        best = i;
+      }
+    }
+    return best;
+  }
+
+  void writePixel(int16_t x, int16_t y, uint8_t index) {
+#if DISPLAY_BPP == 8
+    pixels[y * ILI9341_TFTWIDTH + x] = index;
+#else
+    // Two pixels per byte, the left one in the high nibble
+    uint8_t *p = &pixels[(y * ILI9341_TFTWIDTH + x) >> 1];
+    *p = (x & 1) ? ((*p & 0xF0) | index) : ((*p & 0x0F) | (index << 4));
+#endif
+  }
+
+  void writeSpan(int16_t x, int16_t y, const uint8_t *src, int16_t count) {
+#if DISPLAY_BPP == 8
+    memcpy(&pixels[y * ILI9341_TFTWIDTH + x], src, count);
+#else
+    for (int16_t i = 0; i < count; i++) writePixel(x + i, y, src[i]);
+#endif
+  }
+
+  void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+    int16_t x0 = max(x, clipX0);
+    int16_t x1 = min((int16_t)(x + w), clipX1);
+    int16_t y0 = max(y, clipY0);
+    int16_t y1 = min((int16_t)(y + h), clipY1);
+    uint8_t index = colorIndex(color);
+    if ((x0 >= x1) || (y0 >= y1)) return;
+    for (y = y0; y < y1; y++) {
+#if DISPLAY_BPP == 8
+      memset(&pixels[y * ILI9341_TFTWIDTH + x0], index, x1 - x0);
+#else
+      x = x0;
+      if (x & 1) writePixel(x++, y, index);
+      memset(&pixels[(y * ILI9341_TFTWIDTH + x) >> 1], index * 0x11, (x1 - x) >> 1);
+      if ((x1 - x) & 1) writePixel(x1 - 1, y, index);
+#endif
+    }
+  }
+
+  void fillScreen(uint16_t color) {
+    fillRect(0, 0, width(), height(), color);
+  }
+
+  void drawPixel(int16_t x, int16_t y, uint16_t color) {
+    if ((x >= clipX0) && (x < clipX1) && (y >= clipY0) && (y < clipY1)) writePixel(x, y, colorIndex(color));
+  }
+
+  void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) {
+    if (y0 == y1) {
+      fillRect(min(x0, x1), y0, abs(x1 - x0) + 1, 1, color);
+      return;
+    }
+    if (x0 == x1) {
+      fillRect(x0, min(y0, y1), 1, abs(y1 - y0) + 1, color);
+      return;
+    }
+    // Bresenham
+    int16_t dx = abs(x1 - x0), sx = (x0 < x1) ? 1 : -1;
+    int16_t dy = -abs(y1 - y0), sy = (y0 < y1) ? 1 : -1;
+    int16_t err = dx + dy;
+    while (true) {
+      drawPixel(x0, y0, color);
+      if ((x0 == x1) && (y0 == y1)) break;
+      if (2 * err >= dy) { err += dy; x0 += sx; }
+      if (2 * err <= dx) { err += dx; y0 += sy; }
+    }
+  }
+
+  // Character of the built-in 5x7 font, transparent when background == color
+  void drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t background, uint8_t size) {
+    uint8_t col, row;
+    for (col = 0; col < 6; col++) {
+      uint8_t bits = (col < 5) ? glcdfont[c * 5 + col] : 0;
+      for (row = 0; row < 8; row++, bits >>= 1) {
+        if (bits & 1) fillRect(x + col * size, y + row * size, size, size, color);
+        else if (background != color) fillRect(x + col * size, y + row * size, size, size, background);
+      }
+    }
+  }
+
+  void setCursor(int16_t x, int16_t y) { cursorX = x; cursorY = y; }
+  void setTextColor(uint16_t color) { textColor = textBackground = color; }
+  void setTextColor(uint16_t color, uint16_t background) { textColor = color; textBackground = background; }
+  void setTextSize(uint8_t size) { textSize = size; }
+  void setClipRect(int16_t x, int16_t y, int16_t w, int16_t h) { clipX0 = x; clipY0 = y; clipX1 = x + w; clipY1 = y + h; }
+  void setClipRect() { setClipRect(0, 0, width(), height()); }
+
+  // Same cursor moves and wrapping as ILI9341_t3n
+  size_t write(uint8_t c) override {
+    if (c == '\n') {
+      cursorY += textSize * 8;
+      cursorX = 0;
+    }
+    else if (c != '\r') {
+      drawChar(cursorX, cursorY, c, textColor, textBackground, textSize);
+      cursorX += textSize * 6;
+      if (cursorX > width() - textSize * 6) {
+        cursorY += textSize * 8;
+        cursorX = 0;
+      }
+    }
+    return 1;
+  }
+  using Print::write;
+
+private:
+  int16_t cursorX = 0, cursorY = 0;
+  uint16_t textColor = 0xFFFF, textBackground = 0xFFFF;
+  uint8_t textSize = 1;
+  int16_t clipX0 = 0, clipY0 = 0, clipX1 = ILI9341_TFTWIDTH, clipY1 = ILI9341_TFTHEIGHT;
+};
+
+IndexedFB gfx;
+
+static inline Pixel pixelOf(uint16_t color) { return gfx.colorIndex(color); }
+
+static inline void writePixel(int16_t x, int16_t y, Pixel pixel) {
+  gfx.writePixel(x, y, pixel);
+}
+
+static inline void writeSpan(int16_t x, int16_t y, const Pixel *src, int16_t count) {
+  gfx.writeSpan(x, y, src, count);
+}
+#endif
 
 String monthArray[12] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
 
-char console1[NUMBER_OF_STRINGS1][STRING_LENGTH1 + 1];  // Array to handle console content
-char console2[NUMBER_OF_STRINGS2][STRING_LENGTH2 + 1];  // Array to handle console content
+// Consoles scroll in hardware: each line keeps its slot in the LCD memory,
+// the oldest slot is scrolled to the top of the console area
+#define CONSOLE_TOP           85
+
+typedef struct {
+  Console *lines;   // Ring of lines, lines[head] is the oldest
+  uint8_t count;    // Number of lines
+  uint8_t length;   // Longest message
+  uint8_t size;     // Text size, a line is 8 * size pixels high
+  uint8_t head;     // Slot of the oldest line
+}ConsoleRing;
 
 Console term[NUMBER_OF_STRINGS1];
+Console term2[NUMBER_OF_STRINGS2];
+
+ConsoleRing console1 = {term, NUMBER_OF_STRINGS1, STRING_LENGTH1 - 1, 1, 0};
+ConsoleRing console2 = {term2, NUMBER_OF_STRINGS2, STRING_LENGTH2, 2, 0};
+ConsoleRing *shown = 0;       // Console owning the scroll area
+bool graphShown = false;      // Graph page owns the console area, consoles are not drawn
+int16_t scrollHeight = 0;     // Height of the scroll area, in lines
+bool scrollDefine = false;    // Scroll area to be defined with the next frame
+bool scrollPending = false;   // Scroll offset to be sent with the next frame
+bool frameDefine = false;     // Scroll area of the last frame, not sent yet
+int16_t frameHeight = 0;
+int16_t frameScroll = -1;     // Scroll offset of the last frame not sent yet, -1 -> none
+
+static void showConsole(ConsoleRing *c);
+static void renderWidgets();
+
+// Dirty rectangles, only these areas of the framebuffer are sent to the LCD
+#define MAX_DIRTY             8
+
+typedef struct {
+  int16_t x, y, w, h;
+}Rect;
+
+Rect dirty[MAX_DIRTY];
+uint8_t dirtyCount = 0;
+
+// Frame being sent by DMA, see sendBand()
+DMAMEM uint16_t bandPixels[DISPLAY_BAND_BYTES / 2];
+EventResponder bandEvent;
+Rect sending[MAX_DIRTY];
+uint8_t sendingCount = 0;
+uint8_t sendingIndex = 0;     // Rectangle of the next band
+int16_t sendingRow = 0;       // First row of the next band
+volatile bool frameActive = false;
+
+// Frame governor
+uint32_t frameInterval = 1000 / DISPLAY_MAX_FPS;  // Minimum time between two frames in ms
+uint32_t lastFrame = 0;
+DisplayStats displayStats;
+
+// Accounts the time spent in a display function, nested calls are counted once
+class DisplayTimer {
+  static uint8_t depth;
+  uint32_t start;
+public:
+  DisplayTimer() { if (depth++ == 0) start = micros(); }
+  ~DisplayTimer() { if (--depth == 0) displayStats.busyMicros += micros() - start; }
+};
+uint8_t DisplayTimer::depth = 0;
+
+// Grow a rectangle so that it contains another one
+static void unionRect(Rect *r, int16_t x, int16_t y, int16_t w, int16_t h) {
+  int16_t x1 = max(r->x + r->w, x + w);
+  int16_t y1 = max(r->y + r->h, y + h);
+  r->x = min(r->x, x);
+  r->y = min(r->y, y);
+  r->w = x1 - r->x;
+  r->h = y1 - r->y;
+}
+
+// Area of the union of two rectangles
+static int32_t unionArea(Rect *r, int16_t x, int16_t y, int16_t w, int16_t h) {
+  Rect u = *r;
+  unionRect(&u, x, y, w, h);
+  return (int32_t)u.w * u.h;
+}
+
+// Remember an area of the framebuffer that changed
+void markDirty(int16_t x, int16_t y, int16_t w, int16_t h) {
+  int i;
+  int best = 0;
+  int32_t bestGrowth = 0x7FFFFFFF;
+  // Clip to the screen
+  if (x < 0) { w += x; x = 0; }
+  if (y < 0) { h += y; y = 0; }
+  w = min(w, (int16_t)(tft.width() - x));
+  h = min(h, (int16_t)(tft.height() - y));
+  if ((w <= 0) || (h <= 0)) return;
+  // Merge with an overlapping rectangle
+  for (i = 0; i < dirtyCount; i++) {
+    if ((x <= dirty[i].x + dirty[i].w) && (dirty[i].x <= x + w) && (y <= dirty[i].y + dirty[i].h) && (dirty[i].y <= y + h)) {
+      unionRect(&dirty[i], x, y, w, h);
+      return;
+    }
+  }
+  if (dirtyCount < MAX_DIRTY) {
+    dirty[dirtyCount++] = {x, y, w, h};
+    return;
+  }
+  // List full, grow the rectangle that grows the least
+  for (i = 0; i < dirtyCount; i++) {
+    int32_t growth = unionArea(&dirty[i], x, y, w, h) - (int32_t)dirty[i].w * dirty[i].h;
+    if (growth < bestGrowth) {
+      bestGrowth = growth;
+      best = i;
+    }
+  }
+  unionRect(&dirty[best], x, y, w, h);
+}
+
+// The pending scroll commands go with the frame being sent
+static void takeScroll() {
+  if (scrollDefine) {
+    frameDefine = true;
+    frameHeight = scrollHeight;
+    scrollDefine = false;
+  }
+  if (scrollPending) {
+    // The graph page is not scrolled
+    frameScroll = CONSOLE_TOP + (graphShown ? 0 : shown->head * 8 * shown->size);
+    scrollPending = false;
+  }
+}
+
+// Send the scroll commands of the last frame once its pixels are on the LCD,
+// never while a DMA transfer uses the bus
+static void sendScroll() {
+  if (frameDefine) {
+    tft.setScrollArea(CONSOLE_TOP, frameHeight, tft.height() - CONSOLE_TOP - frameHeight);
+    frameDefine = false;
+  }
+  if (frameScroll >= 0) {
+    tft.setScroll(frameScroll);
+    frameScroll = -1;
+  }
+}
+
+// Copy rows of a rectangle to the band, RGB565 with the high byte first as the LCD wants it
+static void stageRows(const Rect *r, int16_t row, int16_t rows) {
+  uint16_t *out = bandPixels;
+  int16_t x, y;
+  for (y = row; y < row + rows; y++) {
+#if DISPLAY_BPP == 16
+    const uint16_t *in = tft.getFrameBuffer() + y * ILI9341_TFTWIDTH + r->x;
+    for (x = 0; x < r->w; x++) *out++ = __builtin_bswap16(in[x]);
+#elif DISPLAY_BPP == 8
+    const uint8_t *in = gfx.pixels + y * ILI9341_TFTWIDTH + r->x;
+    for (x = 0; x < r->w; x++) *out++ = __builtin_bswap16(gfx.palette[in[x]]);
+#else
+    for (x = r->x; x < r->x + r->w; x++) {
+      uint8_t pair = gfx.pixels[(y * ILI9341_TFTWIDTH + x) >> 1];
+      *out++ = __builtin_bswap16(gfx.palette[(x & 1) ? (pair & 0x0F) : (pair >> 4)]);
+    }
+#endif
+  }
+}
+
+// Stage and send the next band of the frame, then the next one from the DMA
+// interrupt until the frame is out
+static void sendBand() {
+  Rect *r;
+  int16_t rows;
+  if (sendingIndex == sendingCount) {
+    tft.endFrame();
+    frameActive = false;
+    return;
+  }
+  r = &sending[sendingIndex];
+  if (sendingRow == r->y) tft.beginWindow(r->x, r->y, r->w, r->h);
+  rows = min((int16_t)(r->y + r->h - sendingRow), (int16_t)(DISPLAY_BAND_BYTES / 2 / r->w));
+  stageRows(r, sendingRow, rows);
+  sendingRow += rows;
+  if (sendingRow == r->y + r->h) {
+    sendingIndex++;
+    if (sendingIndex < sendingCount) sendingRow = sending[sendingIndex].y;
+  }
+  tft.sendBytes(bandPixels, (uint32_t)rows * r->w * 2, bandEvent);
+}
+
+static void onBandSent(EventResponderRef event) {
+  sendBand();
+}
+
+// Send the dirty rectangles of the framebuffer to the LCD by DMA, the CPU is
+// free meanwhile; the scroll waits for the end of the frame, see serviceDisplay()
+static void sendFrame() {
+  int i;
+  takeScroll();
+  for (i = 0; i < dirtyCount; i++) {
+    sending[i] = dirty[i];
+    displayStats.bytes += (uint32_t)dirty[i].w * dirty[i].h * 2;
+  }
+  sendingCount = dirtyCount;
+  sendingIndex = 0;
+  sendingRow = sending[0].y;
+  frameActive = true;
+  tft.beginFrame();
+  sendBand();
+  displayStats.frames++;
+  lastFrame = millis();
+  dirtyCount = 0;
+}
+
+// Ask for the dirty rectangles to be sent, never waits for the SPI bus
+// While a frame is in flight or too recent, the changes go with the next frame
+void flushDisplay() {
+  if (frameActive) {
+    if (dirtyCount != 0) displayStats.coalesced++;
+    return;
+  }
+  sendScroll();
+  if (dirtyCount == 0) return;
+  if (millis() - lastFrame < frameInterval) {
+    displayStats.coalesced++;
+    return;
+  }
+  sendFrame();
+}
+
+// Render the dashboard and send the changes held back by flushDisplay(),
+// called by a scheduler task
+void serviceDisplay() {
+  DisplayTimer timer;
+  renderWidgets();
+  if (frameActive) return;
+  // The frame is on the LCD, its new lines can be scrolled in
+  sendScroll();
+  if ((dirtyCount != 0) && (millis() - lastFrame >= frameInterval)) {
+    sendFrame();
+  }
+}
+
+// Limit the refresh rate, 0 -> no limit
+void setDisplayRate(uint8_t maxFps) {
+  frameInterval = (maxFps == 0) ? 0 : 1000 / maxFps;
+}
+
+void getDisplayStats(DisplayStats *stats) {
+  *stats = displayStats;
+}
+
+// Glyph cache *************************************************************************
+// Digits, ':' and '-' at text size 2, rasterised once for each color pair
+#define GLYPH_SETS            4
+#define GLYPH_WIDTH           12
+#define GLYPH_HEIGHT          16
+
+const char glyphChars[] = "0123456789:-";
+#define NUMBER_OF_GLYPHS      (sizeof(glyphChars) - 1)
+
+typedef struct {
+  uint16_t color;
+  uint16_t background;
+  Pixel pixels[NUMBER_OF_GLYPHS][GLYPH_HEIGHT][GLYPH_WIDTH];
+}GlyphSet;
+
+GlyphSet glyphSets[GLYPH_SETS];
+uint8_t glyphSetCount = 0;
+
+// Find the glyphs of a color pair, rasterise them the first time
+static GlyphSet *getGlyphSet(uint16_t color, uint16_t background) {
+  uint8_t i, g, col, row;
+  for (i = 0; i < glyphSetCount; i++) {
+    if ((glyphSets[i].color == color) && (glyphSets[i].background == background)) return &glyphSets[i];
+  }
+  if (glyphSetCount == GLYPH_SETS) return 0;
+  GlyphSet *set = &glyphSets[glyphSetCount++];
+  Pixel foregroundPixel = pixelOf(color);
+  Pixel backgroundPixel = pixelOf(background);
+  set->color = color;
+  set->background = background;
+  for (g = 0; g < NUMBER_OF_GLYPHS; g++) {
+    for (col = 0; col < GLYPH_WIDTH / 2; col++) {
+      // 5 columns of 8 bits, top pixel in bit 0, then a blank column
+      uint8_t bits = (col < 5) ? glcdfont[glyphChars[g] * 5 + col] : 0;
+      for (row = 0; row < GLYPH_HEIGHT / 2; row++, bits >>= 1) {
+        Pixel pixel = (bits & 1) ? foregroundPixel : backgroundPixel;
+        set->pixels[g][2 * row][2 * col] = pixel;
+        set->pixels[g][2 * row][2 * col + 1] = pixel;
+        set->pixels[g][2 * row + 1][2 * col] = pixel;
+        set->pixels[g][2 * row + 1][2 * col + 1] = pixel;
+      }
+    }
+  }
+  return set;
+}
+
+// Copy a text into the framebuffer from the glyph cache, cut to [x0, x1[
+// Rows from yOpaque on are copied without their background, as the font path does
+// Returns false when a character or the color pair is not cached
+static bool blitText(int16_t x, int16_t y, const char *text, uint16_t color, uint16_t background,
+                     int16_t x0, int16_t x1, int16_t yOpaque) {
+  const char *c;
+  int16_t row, col;
+  int16_t width = gfx.width();
+  GlyphSet *set = getGlyphSet(color, background);
+  if (set == 0) return false;
+  Pixel backgroundPixel = pixelOf(background);
+  x1 = min(x1, width);
+  for (c = text; *c; c++) {
+    if (strchr(glyphChars, *c) == 0) return false;
+  }
+  for (c = text; *c && (x < x1); c++, x += GLYPH_WIDTH) {
+    const Pixel (*glyph)[GLYPH_WIDTH] = set->pixels[strchr(glyphChars, *c) - glyphChars];
+    int16_t first = max((int16_t)0, (int16_t)(x0 - x));
+    int16_t count = min((int16_t)GLYPH_WIDTH, (int16_t)(x1 - x)) - first;
+    if (count <= 0) continue;
+    for (row = 0; row < GLYPH_HEIGHT; row++) {
+      const Pixel *src = glyph[row] + first;
+      if (y + row < yOpaque) {
+        // Block copy of the whole glyph row
+        writeSpan(x + first, y + row, src, count);
+      }
+      else {
+        for (col = 0; col < count; col++) {
+          if (src[col] != backgroundPixel) writePixel(x + first + col, y + row, src[col]);
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// Dashboard widgets *******************************************************************
+enum {W_TIME, W_DATE, W_WATER, W_PROD, W_PAC, W_ECS, W_HP, W_HC, W_AC, W_LUX, NUMBER_OF_WIDGETS};
+enum {F_NUMBER, F_TIME, F_DATE};
+
+#define WIDGET_TEXT_LENGTH    12
+
+typedef struct {
+  int16_t x, y;               // Text position
+  int16_t fx, fy, fw, fh;     // Background box
+  uint16_t background;
+  uint16_t color;             // Default text color
+  uint8_t format;
+}WidgetDef;
+
+typedef struct {
+  int32_t value;              // Last value given by the update function
+  uint16_t color;
+  bool stale;                 // Value given since the last render pass
+  char text[WIDGET_TEXT_LENGTH];  // Text on screen
+  uint16_t textColor;         // Color of the text on screen
+}Widget;
+
+constexpr WidgetDef widgetDefs[NUMBER_OF_WIDGETS] = {
+  {  0,  0,   0,  0, 120, 14, C_BACKGROUNDTIMEDATE, C_TIME,      F_TIME},    // W_TIME
+  {165,  0, 120,  0, 120, 14, C_BACKGROUNDTIMEDATE, C_DATE,      F_DATE},    // W_DATE
+  { 48, 17,  48, 16,  72, 16, C_BACKGROUND,         C_WATER,     F_NUMBER},  // W_WATER
+  {170, 17, 170, 16,  72, 16, C_BACKGROUND,         C_EMETER,    F_NUMBER},  // W_PROD
+  { 48, 34,  48, 33,  72, 16, C_BACKGROUND,         C_EMETER,    F_NUMBER},  // W_PAC
+  {170, 34, 170, 33,  69, 16, C_BACKGROUND,         C_EMETER,    F_NUMBER},  // W_ECS
+  { 48, 51,  48, 50,  72, 16, C_BACKGROUND,         C_EMETER,    F_NUMBER},  // W_HP
+  {170, 51, 170, 50,  69, 16, C_BACKGROUND,         C_EMETER,    F_NUMBER},  // W_HC
+  { 48, 68,  48, 67,  72, 16, C_BACKGROUND,         C_EMETER,    F_NUMBER},  // W_AC
+  {146, 68, 146, 67,  72, 16, C_BACKGROUND,         C_LUX_LIGHT, F_NUMBER},  // W_LUX
+};
+
+Widget widgets[NUMBER_OF_WIDGETS];
+
+// Store a new value, it is drawn by the next render pass if its text changed
+static void setWidget(uint8_t id, int32_t value, uint16_t color) {
+  widgets[id].value = value;
+  widgets[id].color = color;
+  widgets[id].stale = true;
+}
+
+// Redraw the widgets whose text or color changed since they were drawn
+static void renderWidgets() {
+  int i;
+  char text[WIDGET_TEXT_LENGTH];
+  for (i = 0; i < NUMBER_OF_WIDGETS; i++) {
+    const WidgetDef *def = &widgetDefs[i];
+    Widget *w = &widgets[i];
+    if (!w->stale) continue;
+    w->stale = false;
+    switch (def->format) {
+      case F_TIME : // hh:mm:ss
+        snprintf(text, sizeof(text), "%02ld:%02ld:%02ld", (long)(w->value / 3600), (long)(w->value / 60 % 60), (long)(w->value % 60));
+        break;
+      case F_DATE : // dd-Mon
+        snprintf(text, sizeof(text), "%02ld-%s", (long)(w->value / 100), monthArray[w->value % 100 - 1].c_str());
+        break;
+      default :
+        snprintf(text, sizeof(text), "%ld", (long)w->value);
+        break;
+    }
+    if ((strcmp(text, w->text) == 0) && (w->color == w->textColor)) continue;
+    gfx.fillRect(def->fx, def->fy, def->fw, def->fh, def->background);
+    // A text too long for its box is cut, it never runs over the table
+    if (!blitText(def->x, def->y, text, w->color, def->background, def->fx, def->fx + def->fw, def->fy + def->fh)) {
+      gfx.setClipRect(def->fx, def->y, def->fw, 16);
+      gfx.setCursor(def->x, def->y);
+      gfx.setTextColor(w->color);
+      gfx.setTextSize(2);
+      gfx.print(text);
+      gfx.setClipRect();
+    }
+    markDirty(def->fx, min(def->fy, def->y), def->fw, max(def->fy + def->fh, def->y + 16) - min(def->fy, def->y));
+    strcpy(w->text, text);
+    w->textColor = w->color;
+  }
+}
 
 void initDisplay() {
   int y;
   tft.begin();
+  bandEvent.attachImmediate(&onBandSent);
+#if DISPLAY_BPP == 16
   tft.useFrameBuffer(1);
-  tft.fillScreen(C_BACKGROUND);
+#endif
+  gfx.fillScreen(C_BACKGROUND);
   pinMode(TFT_BL, OUTPUT);
   digitalWrite(TFT_BL, HIGH);
-  tft.setTextColor(C_CONSOLE);
-  tft.setTextSize(2);
-  tft.println("TSplc_v1  2024-Oct");
+  gfx.setTextColor(C_CONSOLE);
+  gfx.setTextSize(2);
+  gfx.println("TSplc_v1  2024-Oct");
   delay(1000);
-  tft.fillScreen(C_BACKGROUND);
+  gfx.fillScreen(C_BACKGROUND);
   // Draw table
-  tft.drawLine(0, 15, 240, 15, C_TABLE); // Horizontal
-  tft.drawLine(0, 32, 240, 32, C_TABLE); // Horizontal
-  tft.drawLine(0, 49, 240, 49, C_TABLE); // Horizontal
-  tft.drawLine(0, 66, 240, 66, C_TABLE); // Horizontal
-  tft.drawLine(0, 83, 240, 83, C_TABLE); // Horizontal
-  tft.drawLine(120, 15, 120, 83, C_TABLE); // Vertical
+  gfx.drawLine(0, 15, 240, 15, C_TABLE); // Horizontal
+  gfx.drawLine(0, 32, 240, 32, C_TABLE); // Horizontal
+  gfx.drawLine(0, 49, 240, 49, C_TABLE); // Horizontal
+  gfx.drawLine(0, 66, 240, 66, C_TABLE); // Horizontal
+  gfx.drawLine(0, 83, 240, 83, C_TABLE); // Horizontal
+  gfx.drawLine(120, 15, 120, 83, C_TABLE); // Vertical
   // Water and Solar panels
-  tft.setCursor(0, 17);
-  tft.setTextColor(C_WATER);
-  tft.print("EAU:");
-  tft.setCursor(125, 17);
-  tft.setTextColor(C_EMETER);
-  tft.print("S:");
+  gfx.setCursor(0, 17);
+  gfx.setTextColor(C_WATER);
+  gfx.print("EAU:");
+  gfx.setCursor(125, 17);
+  gfx.setTextColor(C_EMETER);
+  gfx.print("S:");
   // PAC and ECS
-  tft.setCursor(0, 34);
-  tft.setTextColor(C_EMETER);
-  tft.print("PAC:");
-  tft.setCursor(125, 34);
-  tft.setTextColor(C_EMETER);
-  tft.print("ECS:");
+  gfx.setCursor(0, 34);
+  gfx.setTextColor(C_EMETER);
+  gfx.print("PAC:");
+  gfx.setCursor(125, 34);
+  gfx.setTextColor(C_EMETER);
+  gfx.print("ECS:");
   // Home HP and HC
-  tft.setCursor(0, 51);
-  tft.setTextColor(C_EMETER);
-  tft.print("HP:");
-  tft.setCursor(125, 51);
-  tft.setTextColor(C_EMETER);
-  tft.print("HC:");
+  gfx.setCursor(0, 51);
+  gfx.setTextColor(C_EMETER);
+  gfx.print("HP:");
+  gfx.setCursor(125, 51);
+  gfx.setTextColor(C_EMETER);
+  gfx.print("HC:");
   // AutoConsommation and Lux
-  tft.setCursor(0, 68);
-  tft.setTextColor(C_EMETER);
-  tft.print("AC:");
-  tft.setCursor(125, 68);
-  tft.setTextColor(C_LUX_LIGHT);
-  tft.print("L:");
-  tft.updateScreen();
+  gfx.setCursor(0, 68);
+  gfx.setTextColor(C_EMETER);
+  gfx.print("AC:");
+  gfx.setCursor(125, 68);
+  gfx.setTextColor(C_LUX_LIGHT);
+  gfx.print("L:");
+  markDirty(0, 0, gfx.width(), gfx.height());
+  sendFrame();
+  // Widgets are empty
+  for(y = 0; y < NUMBER_OF_WIDGETS; y++) {
+    widgets[y].stale = false;
+    widgets[y].text[0] = '\0';
+    widgets[y].textColor = widgetDefs[y].color;
+  }
   // Console
   for(y = 0; y < NUMBER_OF_STRINGS1; y++) {
-    strcpy(console1[y], "");
+    strcpy(term[y].message, "");
+    term[y].color = C_CONSOLE;
   }
   for(y = 0; y < NUMBER_OF_STRINGS2; y++) {
-    strcpy(console2[y], "");
+    strcpy(term2[y].message, "");
+    term2[y].color = C_CONSOLE;
   }
+  showConsole(&console1);
+  flushDisplay();
 }
 
 void updateTime() {
-  tft.setCursor(0, 0);
-  tft.setTextColor(C_TIME);
-  tft.setTextSize(2);
-  tft.fillRect(0, 0, 120, 14, C_BACKGROUNDTIMEDATE);
-  // Time
-  if (hour() < 10) tft.print("0");
-  tft.print(hour());
-  tft.print(":");
-  if (minute() < 10) tft.print("0");
-  tft.print(minute());
-  tft.print(":");
-  if (second() < 10) tft.print("0");
-  tft.print(second());
-  tft.updateScreen();
+  setWidget(W_TIME, hour() * 3600L + minute() * 60 + second(), C_TIME);
 }
 
 void updateDate() {
-  tft.setCursor(165, 0);
-  tft.setTextColor(C_DATE);
-  tft.setTextSize(2);
-  tft.fillRect(120, 0, 120, 14, C_BACKGROUNDTIMEDATE);
-  // Date
-  if (day() < 10) tft.print("0");
-  tft.print(day());
-  tft.print("-");
-  tft.print(monthArray[month() - 1]);
-  tft.updateScreen();
+  setWidget(W_DATE, day() * 100 + month(), C_DATE);
 }
 
 void updateWater(int waterVolume) {
-  tft.setCursor(48, 17);
-  tft.setTextColor(C_WATER);
-  tft.setTextSize(2);
-  tft.fillRect(48, 16, 72, 16, C_BACKGROUND);
-  tft.print(waterVolume);
-  tft.updateScreen();
+  setWidget(W_WATER, waterVolume, C_WATER);
 }
 
 void updateProd(int prod) {
-  tft.setCursor(170, 17);
-  tft.setTextColor(C_EMETER);
-  tft.setTextSize(2);
-  tft.fillRect(170, 16, 72, 16, C_BACKGROUND);
-  tft.print(prod);
-  tft.updateScreen();
+  setWidget(W_PROD, prod, C_EMETER);
 }
 
 void updatePAC(int pac) {
-  tft.setCursor(48, 34);
-  tft.setTextColor(C_EMETER);
-  tft.setTextSize(2);
-  tft.fillRect(48, 33, 72, 16, C_BACKGROUND);
-  tft.print(pac);
-  tft.updateScreen();
+  setWidget(W_PAC, pac, C_EMETER);
 }
 
 void updateECS(int ecs) {
-  tft.setCursor(170, 34);
-  tft.setTextColor(C_EMETER);
-  tft.setTextSize(2);
-  tft.fillRect(170, 33, 69, 16, C_BACKGROUND);
-  tft.print(ecs);
-  tft.updateScreen();
+  setWidget(W_ECS, ecs, C_EMETER);
 }
 
 void updateHP(int hp) {
   if (abs(hp) > 1000000) {
     hp = 0;
   }
-  tft.setCursor(48, 51);
-  tft.setTextColor(C_EMETER);
-  tft.setTextSize(2);
-  tft.fillRect(48, 50, 72, 16, C_BACKGROUND);
-  tft.print(hp);
-  tft.updateScreen();
+  setWidget(W_HP, hp, C_EMETER);
 }
 
 void updateHC(int hc) {
   if (abs(hc) > 1000000) {
     hc = 0;
   }
-  tft.setCursor(170, 51);
-  tft.setTextColor(C_EMETER);
-  tft.setTextSize(2);
-  tft.fillRect(170, 50, 69, 16, C_BACKGROUND);
-  tft.print(hc);
-  tft.updateScreen();
+  setWidget(W_HC, hc, C_EMETER);
 }
 
 void updateAC(int ac) {
-  tft.setCursor(48, 68);
-  tft.setTextColor(C_EMETER);
-  tft.setTextSize(2);
-  tft.fillRect(48, 67, 72, 16, C_BACKGROUND);
-  tft.print(ac);
-  tft.updateScreen();
+  setWidget(W_AC, ac, C_EMETER);
 }
 
 void updateLux(int lux, int limitLux) {
-  tft.setCursor(146, 68);
   if (lux < limitLux) {
-    tft.setTextColor(C_LUX_DARK);
+    setWidget(W_LUX, lux, C_LUX_DARK);
+  }
+  else {
+    setWidget(W_LUX, lux, C_LUX_LIGHT);
+  }
+}
+
+// Draw a console line in its slot of the scroll area
+static void drawLine(ConsoleRing *c, uint8_t slot) {
+  int16_t h = 8 * c->size;
+  int16_t y = CONSOLE_TOP + slot * h;
+  gfx.fillRect(0, y, 240, h, C_BACKGROUND);
+  gfx.setCursor(0, y);
+  gfx.setTextSize(c->size);
+  gfx.setTextColor(c->lines[slot].color);
+  gfx.print(c->lines[slot].message);
+  markDirty(0, y, 240, h);
+}
+
+// Give the console area to a console and draw all its lines
+static void showConsole(ConsoleRing *c) {
+  uint8_t slot;
+  shown = c;
+  graphShown = false;
+  scrollHeight = c->count * 8 * c->size;
+  gfx.fillRect(0, 84, 240, 236, C_BACKGROUND);
+  for (slot = 0; slot < c->count; slot++) {
+    drawLine(c, slot);
+  }
+  markDirty(0, 84, 240, 236);
+  scrollDefine = true;
+  scrollPending = true;
+}
+
+// Write a new line over the oldest one, then scroll it to the bottom
+static void appendLine(ConsoleRing *c, char const *message, uint16_t color) {
+  uint8_t slot = c->head;
+  strncpy(c->lines[slot].message, message, c->length);
+  c->lines[slot].message[c->length] = '\0';
+  c->lines[slot].color = color;
+  c->head = (slot + 1) % c->count;
+  if (graphShown) {
+    // The line is drawn when the console is shown again
+    return;
+  }
+  if (shown != c) {
+    showConsole(c);
   }
   else {
-    tft.setTextColor(C_LUX_LIGHT);
+    drawLine(c, slot);
+    scrollPending = true;
   }
-  tft.setTextSize(2);
-  tft.fillRect(146, 67, 72, 16, C_BACKGROUND);
-  tft.print(lux);
-  tft.updateScreen();
 }
 
 // Display content of console from line 6 to 19
 void refreshConsole() {
-  int y;
-  tft.fillRect(0, 84, 240, 236, C_BACKGROUND);
-  tft.setCursor(0, 85);
-  tft.setTextSize(1);
-  for(y = 0; y < NUMBER_OF_STRINGS1; y++) {
-    tft.setTextColor(term[y].color);
-    tft.println(term[y].message);
-  }
+  DisplayTimer timer;
+  showConsole(&console1);
   // Update display
-  tft.updateScreen();
+  flushDisplay();
 }
 
 void addMessage(char const *message, uint16_t msgcolor) {
-  char msg[40];
-  // Be sure message is not bigger than 39 charatcters
-  if (strlen(message) > 39) {
-    strncpy(msg, message, 38);
-    msg[39] = '\0';
-  }
-  else {
-    strcpy(msg, message);
-  }
-  // Shift all lines
-  strcpy(term[0].message, term[1].message);
-  strcpy(term[1].message, term[2].message);
-  strcpy(term[2].message, term[3].message);
-  strcpy(term[3].message, term[4].message);
-  strcpy(term[4].message, term[5].message);
-  strcpy(term[5].message, term[6].message);
-  strcpy(term[6].message, term[7].message);
-  strcpy(term[7].message, term[8].message);
-  strcpy(term[8].message, term[9].message);
-  strcpy(term[9].message, term[10].message);
-  strcpy(term[10].message, term[11].message);
-  strcpy(term[11].message, term[12].message);
-  strcpy(term[12].message, term[13].message);
-  strcpy(term[13].message, term[14].message);
-  strcpy(term[14].message, term[15].message);
-  strcpy(term[15].message, term[16].message);
-  strcpy(term[16].message, term[17].message);
-  strcpy(term[17].message, term[18].message);
-  strcpy(term[18].message, term[19].message);
-  strcpy(term[19].message, term[20].message);
-  strcpy(term[20].message, term[21].message);
-  strcpy(term[21].message, term[22].message);
-  strcpy(term[22].message, term[23].message);
-  strcpy(term[23].message, term[24].message);
-  strcpy(term[24].message, term[25].message);
-  strcpy(term[25].message, term[26].message);
-  strcpy(term[26].message, term[27].message);
-  strcpy(term[27].message, term[28].message);
-  strcpy(term[28].message, msg);
-  term[0].color = term[1].color;
-  term[1].color = term[2].color;
-  term[2].color = term[3].color;
-  term[3].color = term[4].color;
-  term[4].color = term[5].color;
-  term[5].color = term[6].color;
-  term[6].color = term[7].color;
-  term[7].color = term[8].color;
-  term[8].color = term[9].color;
-  term[9].color = term[10].color;
-  term[10].color = term[11].color;
-  term[11].color = term[12].color;
-  term[12].color = term[13].color;
-  term[13].color = term[14].color;
-  term[14].color = term[15].color;
-  term[15].color = term[16].color;
-  term[16].color = term[17].color;
-  term[17].color = term[18].color;
-  term[18].color = term[19].color;
-  term[19].color = term[20].color;
-  term[20].color = term[21].color;
-  term[21].color = term[22].color;
-  term[22].color = term[23].color;
-  term[23].color = term[24].color;
-  term[24].color = term[25].color;
-  term[25].color = term[26].color;
-  term[26].color = term[27].color;
-  term[27].color = term[28].color;
-  term[28].color = msgcolor;
-  refreshConsole();
+  DisplayTimer timer;
+  // Message is cut to 39 characters
+  appendLine(&console1, message, msgcolor);
+  flushDisplay();
 }
 
 // Display content of console from line 6 to 19
 void refreshConsole2() {
-  int y;
-  tft.fillRect(0, 84, 240, 236, C_BACKGROUND);
-  tft.setCursor(0, 85);
-  tft.setTextColor(C_CONSOLE);
-  tft.setTextSize(2);
-  for(y = 0; y < NUMBER_OF_STRINGS2; y++) {
-    tft.println(console2[y]);
-  }
+  DisplayTimer timer;
+  showConsole(&console2);
   // Update display
-  tft.updateScreen();
+  flushDisplay();
 }
 
 void addMessage2(char const *message) {
-  // Shift all lines
-  strcpy(console2[0], console2[1]);
-  strcpy(console2[1], console2[2]);
-  strcpy(console2[2], console2[3]);
-  strcpy(console2[3], console2[4]);
-  strcpy(console2[4], console2[5]);
-  strcpy(console2[5], console2[6]);
-  strcpy(console2[6], console2[7]);
-  strcpy(console2[7], console2[8]);
-  strcpy(console2[8], console2[9]);
-  strcpy(console2[9], console2[10]);
-  strcpy(console2[10], console2[11]);
-  strcpy(console2[11], console2[12]);
-  strcpy(console2[12], console2[13]);
-  strcpy(console2[13], message);
-  refreshConsole2();
+  DisplayTimer timer;
+  appendLine(&console2, message, C_CONSOLE);
+  flushDisplay();
+}
+
+// Graph page **************************************************************************
+// Last 24 hours, one sample per minute in a slot given by the time of day
+// A column sums GRAPH_MINUTES_PER_COLUMN slots, it is redrawn when one of them changes
+#define GRAPH_COLUMNS             240
+#define GRAPH_MINUTES_PER_COLUMN  6
+#define GRAPH_SLOTS               (GRAPH_COLUMNS * GRAPH_MINUTES_PER_COLUMN)
+#define GRAPH_PLOT_HEIGHT         70
+
+enum {G_PROD, G_HC, G_HP, G_WATER, NUMBER_OF_SERIES};
+
+typedef struct {
+  int16_t top;                // Label row, the plot is under it
+  uint16_t scale;             // Full scale of a column
+  const char *label;
+}GraphStrip;
+
+typedef struct {
+  uint8_t strip;              // Series of a strip are stacked in order
+  uint16_t color;
+}GraphSeries;
+
+constexpr GraphStrip graphStrips[] = {
+  { 86, GRAPH_PROD_SCALE,  "Production"},
+  {164, GRAPH_HOUSE_SCALE, "Maison HC / HP"},
+  {242, GRAPH_WATER_SCALE, "Eau"},
+};
+#define NUMBER_OF_STRIPS          (sizeof(graphStrips) / sizeof(graphStrips[0]))
+
+constexpr GraphSeries graphSeries[NUMBER_OF_SERIES] = {
+  {0, C_GRAPH_PROD},          // G_PROD
+  {1, C_GRAPH_HC},            // G_HC
+  {1, C_GRAPH_HP},            // G_HP
+  {2, C_WATER},               // G_WATER
+};
+
+uint16_t history[NUMBER_OF_SERIES][GRAPH_SLOTS];
+time_t lastSample = 0;        // Time of the last sample, 0 -> none yet
+uint16_t lastSlot = 0;
+
+// Draw one column of the graph, only its own pixels are touched
+static void drawColumn(uint16_t column) {
+  uint8_t i, s;
+  uint16_t slot;
+  uint32_t sum[NUMBER_OF_SERIES] = {0};
+  for (slot = column * GRAPH_MINUTES_PER_COLUMN; slot < (column + 1) * GRAPH_MINUTES_PER_COLUMN; slot++) {
+    for (s = 0; s < NUMBER_OF_SERIES; s++) sum[s] += history[s][slot];
+  }
+  for (i = 0; i < NUMBER_OF_STRIPS; i++) {
+    const GraphStrip *strip = &graphStrips[i];
+    int16_t bottom = strip->top + 8 + GRAPH_PLOT_HEIGHT;
+    int16_t y = bottom;
+    uint32_t total = 0;
+    for (s = 0; s < NUMBER_OF_SERIES; s++) {
+      if (graphSeries[s].strip != i) continue;
+      total += sum[s];
+      // Rounded up, a non-zero sum is at least one pixel high
+      int16_t top = bottom - (int16_t)min((uint32_t)GRAPH_PLOT_HEIGHT, (total * GRAPH_PLOT_HEIGHT + strip->scale - 1) / strip->scale);
+      if (top < y) gfx.fillRect(column, top, 1, y - top, graphSeries[s].color);
+      y = top;
+    }
+    if (y > bottom - GRAPH_PLOT_HEIGHT) gfx.fillRect(column, bottom - GRAPH_PLOT_HEIGHT, 1, y - (bottom - GRAPH_PLOT_HEIGHT), C_BACKGROUND);
+    markDirty(column, bottom - GRAPH_PLOT_HEIGHT, 1, GRAPH_PLOT_HEIGHT);
+  }
+}
+
+// Give the console area to the graph page and draw it
+static void showGraph() {
+  uint8_t i;
+  uint16_t column;
+  graphShown = true;
+  gfx.fillRect(0, 84, 240, 236, C_BACKGROUND);
+  gfx.setTextSize(1);
+  gfx.setTextColor(C_TABLE);
+  for (i = 0; i < NUMBER_OF_STRIPS; i++) {
+    gfx.setCursor(0, graphStrips[i].top);
+    gfx.print(graphStrips[i].label);
+  }
+  for (column = 0; column < GRAPH_COLUMNS; column++) {
+    drawColumn(column);
+  }
+  markDirty(0, 84, 240, 236);
+  scrollPending = true;
+}
+
+void refreshGraph() {
+  DisplayTimer timer;
+  showGraph();
+  flushDisplay();
+}
+
+// One minute of history, stored in the slot of the current time
+void addGraphSample(uint16_t prod, uint16_t hp, uint16_t hc, uint16_t water) {
+  DisplayTimer timer;
+  time_t t = now();
+  uint16_t slot = (hour() * 60 + minute()) % GRAPH_SLOTS;
+  uint16_t column = slot / GRAPH_MINUTES_PER_COLUMN;
+  uint16_t skipped = 0;
+  uint16_t i;
+  uint8_t s;
+  // Minutes without a sample are emptied, a clock set backwards skips nothing
+  if ((lastSample != 0) && (t > lastSample) && (slot != lastSlot)) {
+    skipped = (t - lastSample >= 24 * 3600L) ? GRAPH_SLOTS - 1 : (slot + GRAPH_SLOTS - lastSlot - 1) % GRAPH_SLOTS;
+  }
+  for (i = 1; i <= skipped; i++) {
+    for (s = 0; s < NUMBER_OF_SERIES; s++) history[s][(slot + GRAPH_SLOTS - i) % GRAPH_SLOTS] = 0;
+  }
+  // A new column starts empty, its other slots are 24 hours old
+  // whatever minute of it the first sample lands on
+  if ((lastSample == 0) || (column != lastSlot / GRAPH_MINUTES_PER_COLUMN)) {
+    for (i = column * GRAPH_MINUTES_PER_COLUMN; i < (column + 1) * GRAPH_MINUTES_PER_COLUMN; i++) {
+      for (s = 0; s < NUMBER_OF_SERIES; s++) history[s][i] = 0;
+    }
+  }
+  history[G_PROD][slot] = prod;
+  history[G_HP][slot] = hp;
+  history[G_HC][slot] = hc;
+  history[G_WATER][slot] = water;
+  lastSample = t;
+  lastSlot = slot;
+  if (!graphShown) return;
+  if (skipped + GRAPH_MINUTES_PER_COLUMN >= GRAPH_SLOTS) {
+    for (i = 0; i < GRAPH_COLUMNS; i++) drawColumn(i);
+  }
+  else {
+    // Columns of the skipped minutes, then the new one
+    for (i = ((slot + GRAPH_SLOTS - skipped) % GRAPH_SLOTS) / GRAPH_MINUTES_PER_COLUMN; i != column; i = (i + 1) % GRAPH_COLUMNS) {
+      drawColumn(i);
+    }
+    drawColumn(column);
+  }
+  flushDisplay();
+}
+
+// Snapshot ****************************************************************************
+// Screen image as run-length-encoded RGB565 rows, big endian:
+//   "SNAP" width height, then for each row
+//   'R' row length <length bytes of runs> checksum, then "SEND"
+// A run byte n < 0x80 is followed by n + 1 pixels, n >= 0x80 by one pixel repeated n - 0x7F times
+// A record is written in one go when the output can take it without blocking, so
+// other prints on the same link fall between records
+#define SNAPSHOT_BUDGET_US    200
+#define SNAPSHOT_TIMEOUT      5000
+#define SNAPSHOT_RECORD       (6 + 2 * ILI9341_TFTWIDTH + 2 * ((ILI9341_TFTWIDTH + 127) / 128))
+
+Print *snapshotOut = 0;
+int16_t snapshotRow;          // Next row to encode, -1 -> header, height -> trailer
+uint8_t snapshotRecord[SNAPSHOT_RECORD];
+uint16_t snapshotLength = 0;  // Bytes in snapshotRecord, 0 -> sent
+uint32_t snapshotProgress;    // Last time a record was written
+
+// Read a row as shown on the LCD, the console area is scrolled
+static void readScreenRow(int16_t y, uint16_t *pixels) {
+  int16_t x;
+  if (!graphShown && (shown != 0) && (y >= CONSOLE_TOP) && (y < CONSOLE_TOP + scrollHeight)) {
+    y = CONSOLE_TOP + (y - CONSOLE_TOP + shown->head * 8 * shown->size) % scrollHeight;
+  }
+#if DISPLAY_BPP == 16
+  memcpy(pixels, tft.getFrameBuffer() + y * ILI9341_TFTWIDTH, ILI9341_TFTWIDTH * 2);
+  (void)x;
+#elif DISPLAY_BPP == 8
+  for (x = 0; x < ILI9341_TFTWIDTH; x++) pixels[x] = gfx.palette[gfx.pixels[y * ILI9341_TFTWIDTH + x]];
+#else
+  for (x = 0; x < ILI9341_TFTWIDTH; x++) {
+    uint8_t pair = gfx.pixels[(y * ILI9341_TFTWIDTH + x) >> 1];
+    pixels[x] = gfx.palette[(x & 1) ? (pair & 0x0F) : (pair >> 4)];
+  }
+#endif
+}
+
+// Run-length encode a row, returns the number of bytes
+static uint16_t encodeRow(const uint16_t *pixels, int16_t width, uint8_t *out) {
+  int16_t x = 0, n;
+  uint16_t length = 0;
+  while (x < width) {
+    for (n = 1; (x + n < width) && (n < 128) && (pixels[x + n] == pixels[x]); n++);
+    if (n > 1) {
+      out[length++] = 0x7F + n;
+      out[length++] = pixels[x] >> 8;
+      out[length++] = pixels[x] & 0xFF;
+    }
+    else {
+      // Literal pixels up to the next run of two
+      for (n = 1; (x + n < width) && (n < 128) && !((x + n + 1 < width) && (pixels[x + n] == pixels[x + n + 1])); n++);
+      out[length++] = n - 1;
+      for (int16_t i = x; i < x + n; i++) {
+        out[length++] = pixels[i] >> 8;
+        out[length++] = pixels[i] & 0xFF;
+      }
+    }
+    x += n;
+  }
+  return length;
+}
+
+// Fill snapshotRecord with the next record
+static void nextRecord() {
+  uint16_t pixels[ILI9341_TFTWIDTH];
+  uint16_t i, length;
+  uint8_t sum = 0;
+  if (snapshotRow < 0) {
+    memcpy(snapshotRecord, "SNAP", 4);
+    snapshotRecord[4] = ILI9341_TFTWIDTH >> 8;
+    snapshotRecord[5] = ILI9341_TFTWIDTH & 0xFF;
+    snapshotRecord[6] = ILI9341_TFTHEIGHT >> 8;
+    snapshotRecord[7] = ILI9341_TFTHEIGHT & 0xFF;
+    snapshotLength = 8;
+  }
+  else if (snapshotRow == ILI9341_TFTHEIGHT) {
+    memcpy(snapshotRecord, "SEND", 4);
+    snapshotLength = 4;
+  }
+  else {
+    readScreenRow(snapshotRow, pixels);
+    length = encodeRow(pixels, ILI9341_TFTWIDTH, snapshotRecord + 5);
+    for (i = 0; i < length; i++) sum += snapshotRecord[5 + i];
+    snapshotRecord[0] = 'R';
+    snapshotRecord[1] = snapshotRow >> 8;
+    snapshotRecord[2] = snapshotRow & 0xFF;
+    snapshotRecord[3] = length >> 8;
+    snapshotRecord[4] = length & 0xFF;
+    snapshotRecord[5 + length] = sum;
+    snapshotLength = length + 6;
+  }
+  snapshotRow++;
+}
+
+// Start sending the screen to out, false when a snapshot is already running
+bool startSnapshot(Print *out) {
+  if (snapshotOut != 0) return false;
+  snapshotOut = out;
+  snapshotRow = -1;
+  snapshotLength = 0;
+  snapshotProgress = millis();
+  return true;
+}
+
+void stopSnapshot() {
+  snapshotOut = 0;
+}
+
+// Send the next part of the snapshot, called by a scheduler task
+// Returns false once the snapshot is sent or given up
+bool serviceSnapshot() {
+  DisplayTimer timer;
+  uint32_t start = micros();
+  if (snapshotOut == 0) return false;
+  do {
+    if (snapshotLength == 0) {
+      if (snapshotRow > ILI9341_TFTHEIGHT) {
+        stopSnapshot();
+        return false;
+      }
+      nextRecord();
+    }
+    if (snapshotOut->availableForWrite() < snapshotLength) break;
+    snapshotOut->write(snapshotRecord, snapshotLength);
+    snapshotLength = 0;
+    snapshotProgress = millis();
+  } while (micros() - start < SNAPSHOT_BUDGET_US);
+  // The reader went away
+  if (millis() - snapshotProgress > SNAPSHOT_TIMEOUT) {
+    stopSnapshot();
+    return false;
+  }
+  return true;
 }
@@ -17,6 +17,20 @@
 #define TFT_CS 10
 #define TFT_BL 21
 
+// Dirty rectangles are sent by DMA, at most DISPLAY_MAX_FPS frames per second
+// A band of rows of DISPLAY_BAND_BYTES at most is staged at a time, RGB565 in
+// LCD byte order, the next one is started from the DMA interrupt
+#define DISPLAY_MAX_FPS 10
+#define DISPLAY_BAND_BYTES 7680  // 16 full rows
+
+// Framebuffer depth
+// 16   -> RGB565 framebuffer of the driver (153,600 bytes)
+// 8, 4 -> palette framebuffer (76,800 / 38,400 bytes), expanded to RGB565
+//         when a band is staged
+#ifndef DISPLAY_BPP
+#define DISPLAY_BPP 16
+#endif
+
 // Colors
 #define C_BACKGROUND ILI9341_BLACK
 #define C_BACKGROUNDTIMEDATE ILI9341_BLUE
@@ -28,8 +42,28 @@
 #define C_LUX_LIGHT ILI9341_YELLOW
 #define C_LUX_DARK ILI9341_LIGHTSKYBLUE
 #define C_CONSOLE ILI9341_GREEN
+#define C_GRAPH_PROD ILI9341_ORANGE
+#define C_GRAPH_HP ILI9341_RED
+#define C_GRAPH_HC ILI9341_CYAN
+
+// Graph page, full scale of a 6 minute column
+#define GRAPH_PROD_SCALE 600    // Production pulses
+#define GRAPH_HOUSE_SCALE 1200  // HC + HP, Wh
+#define GRAPH_WATER_SCALE 60    // Water, l
+
+typedef struct {
+  uint32_t frames;      // Frames (or dirty rectangle batches) sent to the LCD
+  uint32_t coalesced;   // Flush requests merged into a later frame
+  uint32_t bytes;       // Pixel bytes sent to the LCD
+  uint32_t busyMicros;  // Time spent in display code
+}DisplayStats;
 
 void initDisplay();
+void markDirty(int16_t x, int16_t y, int16_t w, int16_t h);
+void flushDisplay();
+void serviceDisplay();
+void setDisplayRate(uint8_t maxFps);
+void getDisplayStats(DisplayStats *stats);
 void updateTime();
 void updateDate();
 void updateWater(int waterVolume);
@@ -44,5 +78,10 @@ void refreshConsole();
 void addMessage(char const *message, uint16_t msgcolor);
 void refreshConsole2();
 void addMessage2(char const *message);
+void refreshGraph();
+void addGraphSample(uint16_t prod, uint16_t hp, uint16_t hc, uint16_t water);
+bool startSnapshot(Print *out);
+bool serviceSnapshot();
+void stopSnapshot();
 
 #endif
\ No newline at end of file
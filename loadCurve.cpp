@@ -0,0 +1,196 @@
+#include <Arduino.h>
+#include "loadCurve.h"
+
+typedef struct {
+  uint32_t time;            // Start of the minute
+  uint32_t start;           // Position of its first sample in the stream
+  uint64_t present;         // Bit n set when second n has a sample
+} LoadIndex;
+
+typedef struct {
+  LoadAggregate *items;
+  uint16_t size;
+  uint16_t head;            // Next slot written
+  uint16_t count;
+} LoadRing;
+
+typedef struct {
+  uint32_t time;            // Start of the period
+  uint16_t min;
+  uint16_t max;
+  uint32_t sum;
+  uint32_t count;           // Samples, 0 -> no period open
+} LoadAccumulator;
+
+// Per second samples: difference with the previous sample of the minute,
+// zigzag varint, 1 byte up to +-63 VA
+DMAMEM uint8_t loadBytes[LOAD_BYTES];
+DMAMEM LoadIndex loadIndex[LOAD_INDEX];
+DMAMEM LoadAggregate loadMinuteItems[LOAD_MINUTES];
+DMAMEM LoadAggregate loadQuarterItems[LOAD_QUARTERS];
+
+uint32_t loadWritten = 0;         // Bytes written to the stream since boot
+uint16_t loadIndexHead = 0;
+uint16_t loadIndexCount = 0;
+LoadRing loadMinutes = {loadMinuteItems, LOAD_MINUTES, 0, 0};
+LoadRing loadQuarters = {loadQuarterItems, LOAD_QUARTERS, 0, 0};
+LoadAccumulator loadMinute = {0, 0, 0, 0, 0};
+LoadAccumulator loadQuarter = {0, 0, 0, 0, 0};
+uint16_t loadLast = 0;            // Last sample of the minute
+uint32_t loadLastTime = 0;
+
+// ****************************************************************************
+// ******************************** Rings *************************************
+// ****************************************************************************
+static void pushRing(LoadRing *ring, const LoadAccumulator *acc) {
+  LoadAggregate *a = &ring->items[ring->head];
+  a->time = acc->time;
+  a->min = acc->min;
+  a->max = acc->max;
+  a->mean = acc->sum / acc->count;
+  ring->head = (ring->head + 1) % ring->size;
+  if (ring->count < ring->size) ring->count++;
+}
+
+static void accumulate(LoadAccumulator *acc, uint32_t time, uint16_t min, uint16_t max, uint32_t sum, uint32_t count) {
+  if (acc->count == 0) {
+    acc->time = time;
+    acc->min = min;
+    acc->max = max;
+    acc->sum = 0;
+  }
+  if (min < acc->min) acc->min = min;
+  if (max > acc->max) acc->max = max;
+  acc->sum += sum;
+  acc->count += count;
+}
+
+static void putByte(uint8_t b) {
+  loadBytes[loadWritten % LOAD_BYTES] = b;
+  loadWritten++;
+}
+
+static void putDelta(int32_t delta) {
+  uint32_t z = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+  while (z >= 0x80) {
+    putByte(z | 0x80);
+    z >>= 7;
+  }
+  putByte(z);
+}
+
+static int32_t getDelta(uint32_t *pos) {
+  uint32_t z = 0;
+  uint8_t shift = 0;
+  uint8_t b;
+  do {
+    b = loadBytes[(*pos)++ % LOAD_BYTES];
+    z |= (uint32_t)(b & 0x7F) << shift;
+    shift += 7;
+  } while ((b & 0x80) && (shift < 32));
+  return (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+}
+
+// ****************************************************************************
+// ******************************* Recorder ***********************************
+// ****************************************************************************
+// The minute is kept, its samples go to the quarter in progress
+static void closeMinute() {
+  if (loadMinute.count == 0) return;
+  pushRing(&loadMinutes, &loadMinute);
+  accumulate(&loadQuarter, loadMinute.time - loadMinute.time % 900, loadMinute.min, loadMinute.max, loadMinute.sum, loadMinute.count);
+  loadMinute.count = 0;
+}
+
+// Apparent power of one second, TimeLib time
+void addLoadSample(uint32_t time, unsigned long power) {
+  uint16_t va = (power > 0xFFFF) ? 0xFFFF : power;
+  uint32_t minuteStart = time - time % 60;
+  if (time == loadLastTime) return;
+  // New minute, or the clock was set back
+  if ((minuteStart != loadMinute.time) || (time < loadLastTime)) {
+    closeMinute();
+  }
+  if (loadMinute.count == 0) {
+    if ((loadQuarter.count > 0) && (loadQuarter.time != minuteStart - minuteStart % 900)) {
+      pushRing(&loadQuarters, &loadQuarter);
+      loadQuarter.count = 0;
+    }
+    LoadIndex *entry = &loadIndex[loadIndexHead];
+    entry->time = minuteStart;
+    entry->start = loadWritten;
+    entry->present = 0;
+    loadIndexHead = (loadIndexHead + 1) % LOAD_INDEX;
+    if (loadIndexCount < LOAD_INDEX) loadIndexCount++;
+    loadLast = 0;
+  }
+  loadIndex[(loadIndexHead + LOAD_INDEX - 1) % LOAD_INDEX].present |= 1ULL << (time - minuteStart);
+  putDelta((int32_t)va - loadLast);
+  loadLast = va;
+  loadLastTime = time;
+  accumulate(&loadMinute, minuteStart, va, va, va, 1);
+}
+
+// ****************************************************************************
+// ******************************** Query *************************************
+// ****************************************************************************
+static uint16_t querySeconds(uint32_t from, uint32_t to, LoadAggregate *out, uint16_t size) {
+  uint16_t n = 0;
+  for (uint16_t i = 0; i < loadIndexCount; i++) {
+    LoadIndex *entry = &loadIndex[(loadIndexHead + LOAD_INDEX - loadIndexCount + i) % LOAD_INDEX];
+    // Overwritten by later samples
+    if (loadWritten - entry->start > LOAD_BYTES) continue;
+    if ((entry->time + 59 < from) || (entry->time > to)) continue;
+    uint32_t pos = entry->start;
+    uint16_t value = 0;
+    for (uint8_t s = 0; s < 60; s++) {
+      if (!(entry->present & (1ULL << s))) continue;
+      value += getDelta(&pos);
+      uint32_t time = entry->time + s;
+      if ((time < from) || (time > to)) continue;
+      if (n >= size) return n;
+      out[n].time = time;
+      out[n].min = value;
+      out[n].max = value;
+      out[n].mean = value;
+      n++;
+    }
+  }
+  return n;
+}
+
+static uint16_t queryRing(const LoadRing *ring, const LoadAccumulator *open, uint32_t from, uint32_t to, LoadAggregate *out, uint16_t size) {
+  uint16_t n = 0;
+  for (uint16_t i = 0; (i < ring->count) && (n < size); i++) {
+    const LoadAggregate *a = &ring->items[(ring->head + ring->size - ring->count + i) % ring->size];
+    if ((a->time >= from) && (a->time <= to)) out[n++] = *a;
+  }
+  if ((open->count > 0) && (open->time >= from) && (open->time <= to) && (n < size)) {
+    out[n].time = open->time;
+    out[n].min = open->min;
+    out[n].max = open->max;
+    out[n].mean = open->sum / open->count;
+    n++;
+  }
+  return n;
+}
+
+// Samples or aggregates whose period starts between from and to, oldest
+// first, the period in progress last; returns how many were written to out
+uint16_t queryLoad(uint8_t resolution, uint32_t from, uint32_t to, LoadAggregate *out, uint16_t size) {
+  if (resolution == LOAD_SECOND) {
+    return querySeconds(from, to, out, size);
+  }
+  else if (resolution == LOAD_MINUTE) {
+    return queryRing(&loadMinutes, &loadMinute, from, to, out, size);
+  }
+  else if (resolution == LOAD_QUARTER) {
+    // The quarter in progress with the minute in progress
+    LoadAccumulator open = loadQuarter;
+    if (loadMinute.count > 0) {
+      accumulate(&open, loadMinute.time - loadMinute.time % 900, loadMinute.min, loadMinute.max, loadMinute.sum, loadMinute.count);
+    }
+    return queryRing(&loadQuarters, &open, from, to, out, size);
+  }
+  return 0;
+}
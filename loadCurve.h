@@ -0,0 +1,26 @@
+#ifndef LOADCURVE_H
+#define LOADCURVE_H
+
+#include <Arduino.h>
+
+#define LOAD_BYTES     16384     // Per second samples, delta encoded (~4 h at 1 byte/s)
+#define LOAD_INDEX     512       // Minutes that may still have per second samples
+#define LOAD_MINUTES   1440      // Minute aggregates kept, 24 h
+#define LOAD_QUARTERS  672       // 15 minute aggregates kept, 7 days
+
+// Resolutions of queryLoad()
+#define LOAD_SECOND    0
+#define LOAD_MINUTE    1
+#define LOAD_QUARTER   2
+
+typedef struct {
+  uint32_t time;            // Start of the period, TimeLib time
+  uint16_t min;             // Apparent power, VA
+  uint16_t max;
+  uint16_t mean;
+} LoadAggregate;
+
+void addLoadSample(uint32_t time, unsigned long power);
+uint16_t queryLoad(uint8_t resolution, uint32_t from, uint32_t to, LoadAggregate *out, uint16_t size);
+
+#endif
@@ -19,6 +19,8 @@
 #include "display.h"
 #include "SIM7600.h"
 #include "sensors.h"
+#include "smsOutbox.h"
+#include "loadCurve.h"
 #include "main.h"
 #include "Watchdog_t4.h"
 
@@ -36,6 +38,11 @@ char user[] = "xxxx";             // MySQL user login username
 char password[] = "xxxx";    // MySQL user login password
 MySQL_Connection conn((Client *)&client);
 
+// Diagnostic commands
+EthernetServer diagServer(DIAG_PORT);
+EthernetClient diagClient;
+bool netSnapshot = false;  // Snapshot sent to diagClient
+
 // GPS
 byte gpsTimeZone = 1;           // -12 to +12 (1 for Paris)
 byte gpsTimeDST = 1;            // 0 or 1 (1 to adjust DST automatically)
@@ -47,7 +54,6 @@ volatile bool dryTowel1Done = false;
 volatile bool dryTowel2Done = false;
 
 bool receivedSMS = false;
-char messageSMS[128];
 
 // Energy meters
 volatile long cntProd = 0;
@@ -55,7 +61,8 @@ volatile long cntECS = 0;
 volatile long cntPAC = 0;
 volatile long cntAC = 0;
 
-unsigned char serial4buffer[2000];
+unsigned char serial4buffer[TI_RX_BUFFER];
+unsigned char serial1buffer[4096];
 
 boolean waterDone = false;
 
@@ -63,20 +70,33 @@ pushButton lineProd(emProd);
 pushButton lineECS(emECS);
 pushButton linePAC(emPAC);
 pushButton lineAC(emAC);
+pushButton pageButton(portA[7]);   // Console / graph page
+bool graphPage = false;
 
-char SIM7600InBuffer[64]; // For notifications from the FONA
-char callerIDbuffer[32];  // We'll store the SMS sender number in here
-char SMSbuffer[32];       // We'll store the SMS content in here
-uint16_t SMSLength;
-String SMSString = "";
+SIM7600SMS inbox[10];     // Messages listed from the SIM
+bool checkInbox = true;   // Set by +CMTI, true at boot to pick up messages received while we were down
+uint8_t smsHandled[10];   // Slots already decoded, waiting for their AT+CMGD
+uint8_t smsHandledCount = 0;
+bool smsDeleteRead = false; // Every handled slot goes with one AT+CMGD=1,1
 
 int indexTempo = 0;
 
 Scheduler runner;
 Task tAlarm(100, TASK_FOREVER, &alarm, &runner, true);
 Task tGSM(100, TASK_FOREVER, &gsm, &runner, true);
-Task tSyncGPS(500, TASK_ONCE, &synchronizeTime, &runner, false);
+Task tModem(1, TASK_FOREVER, &modemPoll, &runner, true);
+Task tOutbox(100, TASK_FOREVER, &drainOutbox, &runner, true);
+Task tModemStats(TASK_HOUR, TASK_FOREVER, &modemStats, &runner, false);
+Task tModemLink(100, TASK_FOREVER, &modemLink, &runner, false);
+Task tDisplay(10, TASK_FOREVER, &serviceDisplay, &runner, true);
+Task tDisplayLoad(TASK_MINUTE, TASK_FOREVER, &displayLoad, &runner, true);
+Task tTeleInfoLink(TASK_MINUTE, TASK_FOREVER, &teleInfoLink, &runner, true);
+Task tSyncGPS(2000, TASK_FOREVER, &synchronizeTime, &runner, false);
 Task tRecordEMeter(1000, TASK_FOREVER, &recordEnergyMeter, &runner, true);
+Task tRecordGraph(TASK_MINUTE, TASK_FOREVER, &recordGraph, &runner, true);
+Task tRecordLoad(TASK_SECOND, TASK_FOREVER, &recordLoad, &runner, true);
+Task tDiagnostics(100, TASK_FOREVER, &diagnostics, &runner, true);
+Task tSnapshot(1, TASK_FOREVER, &snapshot, &runner, false);
 Task tPulseLightInside(60 * TASK_SECOND, TASK_ONCE, NULL, &runner, false, &taskLightInsideOn, &taskLightInsideOff);    // Delay 60s for garage light
 Task tPulseLightOutside(60 * TASK_SECOND, TASK_ONCE, NULL, &runner, false, &taskLightOutsideOn, &taskLightOutsideOff); // Delay 60s for outside light
 Task tPulseDryTowel1(30 * TASK_MINUTE, TASK_ONCE, NULL, &runner, false, &taskDryTowel1On, &taskDryTowel1Off);
@@ -116,79 +136,290 @@ void taskLightOutsideOff() {
   //addMessage(msg, ILI9341_AZURE);
 }
 
+// Modem command engine
+void modemPoll() {
+  sim7600.poll();
+}
+
+// Modem link lost, look for its rate one probe at a time
+void modemLink() {
+  if (sim7600.probeBaudrate(*SIM7600Serial) != 0) {
+    tModemLink.disable();
+    tGSM.forceNextIteration();
+  }
+}
+
+// SMS outbox counters since startup
+static void printOutbox(Print *out) {
+  const OutboxStats *stats = getOutboxStats();
+  char line[192];
+  snprintf(line, sizeof(line), "Outbox: %u queued now (max %u), %lu queued, %lu sent, %lu failed, %lu dropped, %lu retries, latency %lu ms mean %lu ms max",
+           stats->depth, stats->maxDepth, (unsigned long)stats->queued, (unsigned long)stats->sent, (unsigned long)stats->failed,
+           (unsigned long)stats->dropped, (unsigned long)stats->retries,
+           (unsigned long)(stats->sent ? stats->totalLatency / stats->sent : 0), (unsigned long)stats->maxLatency);
+  out->println(line);
+}
+
+// AT command latencies and SMS outbox, dumped on the USB serial every hour
+void modemStats() {
+  sim7600.printStats(Serial);
+  printOutbox(&Serial);
+}
+
+// Display load over the last minute, on the USB serial
+void displayLoad() {
+  static DisplayStats prev;
+  DisplayStats stats;
+  char msg[128];
+  getDisplayStats(&stats);
+  snprintf(msg, sizeof(msg), "Display: %lu frames, %lu coalesced, %lu bytes/s, %lu us/s busy",
+           (unsigned long)(stats.frames - prev.frames), (unsigned long)(stats.coalesced - prev.coalesced),
+           (unsigned long)((stats.bytes - prev.bytes) / 60), (unsigned long)((stats.busyMicros - prev.busyMicros) / 60));
+  Serial.println(msg);
+  prev = stats;
+}
+
+// TeleInfo link quality over the last minute, on the console when it degrades
+void teleInfoLink() {
+  static TeleInfoStats prev;
+  static bool degraded = false;
+  TeleInfoStats stats;
+  char msg[160];
+  getTeleInfoStats(&stats);
+  uint32_t lines = stats.lines - prev.lines;
+  uint32_t bad = (stats.checksumErrors - prev.checksumErrors) + (stats.overlongLines - prev.overlongLines);
+  uint32_t overruns = stats.overruns - prev.overruns;
+  snprintf(msg, sizeof(msg), "TeleInfo: %lu frames, %lu lines, %lu checksum, %lu overlong, %lu search, %lu parity, %lu overruns, last frame %lu ms ago",
+           (unsigned long)(stats.frames - prev.frames), (unsigned long)lines, (unsigned long)(stats.checksumErrors - prev.checksumErrors),
+           (unsigned long)(stats.overlongLines - prev.overlongLines), (unsigned long)(stats.searchErrors - prev.searchErrors),
+           (unsigned long)(stats.parityErrors - prev.parityErrors),
+           (unsigned long)overruns, (unsigned long)stats.lastValidAge);
+  Serial.println(msg);
+  prev = stats;
+
+  // Length   123456789ABCDFGHIJKL
+  if (stats.lastValidAge > TI_LINK_LOST) {
+    snprintf(msg, sizeof(msg), "TeleInfo lost");
+  }
+  else if (bad * 100 > (lines + bad) * TI_LINK_ERRORS) {
+    snprintf(msg, sizeof(msg), "TeleInfo errors %lu%%", (unsigned long)(bad * 100 / (lines + bad)));
+  }
+  else if (overruns > 0) {
+    snprintf(msg, sizeof(msg), "TeleInfo overrun");
+  }
+  else {
+    if (degraded) addMessage("TeleInfo ok", ILI9341_GREEN);
+    degraded = false;
+    return;
+  }
+  if (!degraded) addMessage(msg, ILI9341_RED);
+  degraded = true;
+}
+
+// Collect a command line from a stream, true once it is complete
+static bool readCommand(Stream &in, char *line, uint8_t *length, uint8_t size) {
+  while (in.available()) {
+    char c = in.read();
+    if ((c == '\r') || (c == '\n')) {
+      if (*length == 0) continue;
+      line[*length] = '\0';
+      *length = 0;
+      return true;
+    }
+    if (*length < size - 1) line[(*length)++] = c;
+  }
+  return false;
+}
+
+// Load curve, one line per sample or aggregate: time min max mean (VA)
+static void printLoad(Print *out, uint8_t resolution, uint32_t span) {
+  LoadAggregate rows[96];
+  char line[40];
+  uint32_t to = now();
+  uint16_t n = queryLoad(resolution, to - span, to, rows, sizeof(rows) / sizeof(rows[0]));
+  for (uint16_t i = 0; i < n; i++) {
+    snprintf(line, sizeof(line), "%02d:%02d:%02d %u %u %u", hour(rows[i].time), minute(rows[i].time), second(rows[i].time),
+             rows[i].min, rows[i].max, rows[i].mean);
+    out->println(line);
+  }
+}
+
+static void doDiagnostic(const char *cmd, Print *out, bool net) {
+  if (strcmp(cmd, "loads") == 0) {
+    printLoad(out, LOAD_SECOND, 59);            // Last minute
+  }
+  else if (strcmp(cmd, "load") == 0) {
+    printLoad(out, LOAD_MINUTE, 59 * 60);       // Last hour
+  }
+  else if (strcmp(cmd, "loadq") == 0) {
+    printLoad(out, LOAD_QUARTER, 95 * 15 * 60); // Last day
+  }
+  else if (strcmp(cmd, "sms") == 0) {
+    printOutbox(out);
+  }
+  else if (strcmp(cmd, "snap") == 0) {
+    // Screen image, decoded by tools/snapshot.py
+    if (startSnapshot(out)) {
+      netSnapshot = net;
+      tSnapshot.enable();
+    }
+    else {
+      out->println("busy");
+    }
+  }
+  else {
+    out->println("?");
+  }
+}
+
+// Diagnostic commands, one per line, on the USB serial and on TCP port DIAG_PORT
+void diagnostics() {
+  static char serialLine[16];
+  static uint8_t serialLength = 0;
+  static char netLine[16];
+  static uint8_t netLength = 0;
+  if (readCommand(Serial, serialLine, &serialLength, sizeof(serialLine))) {
+    doDiagnostic(serialLine, &Serial, false);
+  }
+  if (!diagClient.connected()) {
+    // Connection closed, its snapshot is given up
+    if (netSnapshot && tSnapshot.isEnabled()) {
+      stopSnapshot();
+      tSnapshot.disable();
+    }
+    netSnapshot = false;
+    diagClient = diagServer.accept();
+    netLength = 0;
+    return;
+  }
+  if (readCommand(diagClient, netLine, &netLength, sizeof(netLine))) {
+    doDiagnostic(netLine, &diagClient, true);
+  }
+}
+
+// Screen snapshot, a few rows at each run
+void snapshot() {
+  if (!serviceSnapshot()) {
+    tSnapshot.disable();
+  }
+}
+
+// Modem notifications
+void onNewSMS(const char *urc, void *ctx) {
+  // +CMTI: "SM",3 -> whole inbox is read in one go
+  checkInbox = true;
+  holdOutbox(true);
+  tGSM.forceNextIteration();
+}
+
+void onModemEvent(const char *urc, void *ctx) {
+  char msg[128];
+  Serial.println(urc);
+  snprintf(msg, sizeof(msg), "%02d:%02d:%02d - %s", hour(), minute(), second(), urc);
+  addMessage(msg, ILI9341_AZURE);
+}
+
+// Delete the handled slots, true once none is left
+static bool deleteHandledSMS() {
+  uint8_t i = 0;
+  if (smsDeleteRead) {
+    // Listing marked them all as read
+    if (!sim7600.deleteReadSMS()) return false;
+    smsDeleteRead = false;
+    smsHandledCount = 0;
+    return true;
+  }
+  while (i < smsHandledCount) {
+    if (sim7600.deleteSMS(smsHandled[i])) {
+      smsHandled[i] = smsHandled[--smsHandledCount];
+    }
+    else {
+      i++;
+    }
+  }
+  return (smsHandledCount == 0);
+}
+
 // GSM
 void gsm() {
-  char* bufPtr = SIM7600InBuffer; // Handy buffer pointer
   char* status;
   char msg[128];
+  uint8_t total = 0;
+  int8_t count;
+  int i;
 
-  if (sim7600.available()) { // Any data available from the SIM7600
-    int slot = 0; // This will be the slot number of the SMS
-    unsigned int charCount = 0;
+  // While the inbox has work the outbox sends nothing new, so that the calls below find the modem idle
+  holdOutbox(checkInbox || (smsHandledCount > 0) || tModemLink.isEnabled());
 
-#if FAKE
-    digitalWrite(portB[1], !digitalRead(portB[1]));
-#endif
+  // Looking for the modem rate
+  if (tModemLink.isEnabled()) {
+    return;
+  }
 
-    // Read the notification into fonaInBuffer
-    do {
-      *bufPtr = sim7600.read();
-      Serial.write(*bufPtr);
-      delay(1);
-    } while ((*bufPtr++ != '\n') && (sim7600.available()) && (++charCount < (sizeof(SIM7600InBuffer) - 1)));
-
-    // Add a terminal NULL to the notification string
-    *bufPtr = 0;
-
-    // Scan the notification string for an SMS received notification.
-    // If it's an SMS message, we'll get the slot number in 'slot'
-    if (1 == sscanf(SIM7600InBuffer, "+CMTI: \"SM\",%d", &slot)) {
-      sprintf(msg, "Slot : %d", slot);
-      // Length   123456789ABCDFGHIJKLMNOPQRSTUVWXYZ1234
-      addMessage(msg, ILI9341_GREEN);
-      // Retrieve SMS sender address/phone number.
-      if (!sim7600.getSMSSender(slot, callerIDbuffer, 31)) {
-        // Length   123456789ABCDFGHIJKLMNOPQRSTUVWXYZ1234
-        addMessage("Didn't find SMS message in slot !", ILI9341_RED);
-      }
-      sprintf(msg, "From : %s", callerIDbuffer);
-      addMessage(msg, ILI9341_VIOLET);
+  // An outbox SMS in flight, the calls below would give up, come back once it is sent
+  if (sim7600.busy()) {
+    return;
+  }
 
-      if (!sim7600.readSMS(slot, SMSbuffer, 250, &SMSLength)) { // pass in buffer and max len!
-        addMessage("Read SMS failed !", ILI9341_RED);
-      }
-      else {
-        SMSString = String(SMSbuffer);
-        // Must not be more than 128 chars
-        SMSString = SMSString.substring(0, 127);
-        sprintf(msg, "%02d:%02d:%02d - SMS : %s", hour(), minute(), second(), SMSString.c_str());
-        addMessage(msg, ILI9341_GREEN);
-      }
+  // Modem restarted on its own, configure it again
+  if (sim7600.wasReset()) {
+    // Length   123456789ABCDFGHIJKLMNOPQRSTUVWXYZ1234
+    addMessage("SIM7600 restarted", ILI9341_ORANGE);
+    sim7600.sendCheckReply(F("ATE0"), F("OK"));
+    sim7600.setSMSRouting(2, 1);
+    sim7600.enableGPS(true);
+    sim7600.reportNMEA(1);
+    checkInbox = true;
+  }
 
-      status = decodeSMS(callerIDbuffer, SMSString.c_str());
-      if (strcmp(status, "") != 0) {
-        if (!sim7600.sendSMS(DENIS, status)) {
-          addMessage("Failed to send SMS !", ILI9341_RED);
-        }
-        else {
-          // Length   123456789ABCDFGHIJKL
-          addMessage("SMS Sent", ILI9341_GREEN);
-        }
-      }
-      // Delete the original msg after it is processed otherwise, we will fill up all the slots and then we won't be able to receive SMS anymore
-      while (1) {
-        boolean deleteSMSDone = sim7600.deleteSMS(slot);
-        if (deleteSMSDone == true) {
-          Serial.println("OK!");
-          break;
-        }
-        else {
-          Serial.println("Couldn't delete, try again.");
-        }
+  // Messages decoded on a previous pass whose deletion failed, only the AT+CMGD is sent again
+  // and the inbox is not listed before they are gone, so they are never decoded twice
+  if (smsHandledCount > 0) {
+    if (!deleteHandledSMS()) return;
+  }
+
+  if (!checkInbox) {
+    return;
+  }
+
+#if FAKE
+  digitalWrite(portB[1], !digitalRead(portB[1]));
+#endif
+
+  count = sim7600.listSMS(inbox, sizeof(inbox) / sizeof(inbox[0]), &total);
+  if (count < 0) {
+    // Length   123456789ABCDFGHIJKLMNOPQRSTUVWXYZ1234
+    addMessage("Can't list SMS !", ILI9341_RED);
+    // The modem may have restarted at its saved rate
+    tModemLink.enable();
+    return;
+  }
+  checkInbox = false;
+
+  for (i = 0; i < count; i++) {
+    snprintf(msg, sizeof(msg), "Slot : %d From : %s", inbox[i].index, inbox[i].sender);
+    addMessage(msg, ILI9341_VIOLET);
+    snprintf(msg, sizeof(msg), "%02d:%02d:%02d - SMS : %s", hour(), minute(), second(), inbox[i].text);
+    addMessage(msg, ILI9341_GREEN);
+
+    status = decodeSMS(inbox[i].sender, inbox[i].text);
+    if (strcmp(status, "") != 0) {
+      if (!queueSMS(DENIS, status, SMS_PRIORITY_STATUS)) {
+        addMessage("SMS outbox full !", ILI9341_RED);
       }
     }
+    free(status);
+    smsHandled[smsHandledCount++] = inbox[i].index;
+  }
+
+  // Delete the processed messages otherwise, we will fill up all the slots and then we won't be able to receive SMS anymore
+  // When everything was listed one AT+CMGD=1,1 does it, else only those processed go and we come back for the others
+  if (total > count) checkInbox = true;
+  if (smsHandledCount == 0) return;
+  smsDeleteRead = (total <= count);
+  if (!deleteHandledSMS()) {
+    addMessage("Couldn't delete SMS", ILI9341_RED);
   }
-  sendSMS();
 }
 
 // Task Sensors
@@ -222,14 +453,14 @@ void alarm() {
   // Port A0 = motion detector service door **********************************
   if ((digitalRead(portA[0]) == 0) && (alarmActive == 1)) {
     if (millis() - prevAlarm1 >= timeBetweenSMS) {
-      strcpy(messageSMS, "Detection mouvement porte de service");
+      queueSMS(DENIS, "Detection mouvement porte de service", SMS_PRIORITY_ALARM);
       prevAlarm1 = millis();
     }
   }
   // Port A1 = motion detector cars ******************************************
   if ((digitalRead(portA[1]) == 0) && (alarmActive == 1)) {
     if (millis() - prevAlarm2 >= timeBetweenSMS) {
-      strcpy(messageSMS, "Detection mouvement voiture");
+      queueSMS(DENIS, "Detection mouvement voiture", SMS_PRIORITY_ALARM);
       prevAlarm2 = millis();
     }
   }
@@ -246,28 +477,28 @@ void alarm() {
   // Port A4 garage door *****************************************************
   if ((digitalRead(portA[4]) == 1) && (alarmActive == 1)) {
     if (millis() - prevAlarm2 >= timeBetweenSMS) {
-      strcpy(messageSMS, "Portail Cecile ouvert");
+      queueSMS(DENIS, "Portail Cecile ouvert", SMS_PRIORITY_ALARM);
       prevAlarm2 = millis();
     }
   }
   // Port A5 garage door *****************************************************
   if ((digitalRead(portA[5]) == 1) && (alarmActive == 1)) {
     if (millis() - prevAlarm2 >= timeBetweenSMS) {
-      strcpy(messageSMS, "Portail Denis ouvert");
+      queueSMS(DENIS, "Portail Denis ouvert", SMS_PRIORITY_ALARM);
       prevAlarm2 = millis();
     }
   }
   // Port A6 = IR Barrier detector *******************************************
   if ((digitalRead(portA[6]) == 1) && (alarmActive == 1)) {
     if (millis() - prevAlarm2 >= timeBetweenSMS) {
-      strcpy(messageSMS, "IR Barrier");
+      queueSMS(DENIS, "IR Barrier", SMS_PRIORITY_ALARM);
        prevAlarm2 = millis();
     }
   }
   // Port C0 = Grid power failure ********************************************
   if ((digitalRead(portC[0]) == 1) && (powerFail == 0)) {
     if (millis() - prevAlarm2 >= timeBetweenSMS) {
-      strcpy(messageSMS, "Grid power back");
+      queueSMS(DENIS, "Grid power back", SMS_PRIORITY_ALARM);
       powerFail = 1;
       prevAlarm2 = millis();
       sprintf(msg, "%02d:%02d:%02d - Grid power back", hour(), minute(), second());
@@ -276,7 +507,7 @@ void alarm() {
   }
   if ((digitalRead(portC[0]) == 0) && (powerFail == 1)) {
     if (millis() - prevAlarm2 >= timeBetweenSMS) {
-      strcpy(messageSMS, "Grid power failure");
+      queueSMS(DENIS, "Grid power failure", SMS_PRIORITY_ALARM);
       powerFail = 0;
       prevAlarm2 = millis();
       sprintf(msg, "%02d:%02d:%02d - Grid power failure", hour(), minute(), second());
@@ -358,11 +589,58 @@ void resetIndex() {
   cntAC = 0;
 }
 
+// Increase of a daily counter, it restarts from 0 after the record in DB
+static uint16_t counterDelta(unsigned long value, unsigned long prev) {
+  unsigned long delta = (value < prev) ? value : value - prev;
+  return (delta > 0xFFFF) ? 0xFFFF : delta;
+}
+
+// One minute of production, HP/HC and water for the graph page
+void recordGraph() {
+  static bool started = false;
+  static bool tiStarted = false;
+  static unsigned long prevProd, prevHP, prevHC, prevWater;
+  TeleInfoData ti;
+  bool tiValid = getTeleInfo(&ti);
+  unsigned long prod = cntProd;
+  unsigned long vol = water;
+  uint16_t hp = 0;
+  uint16_t hc = 0;
+  // Without a valid frame HP/HC stay empty and keep their reference,
+  // the energy of the outage goes to the first minute after it
+  if (tiValid) {
+    if (tiStarted) {
+      hp = counterDelta(ti.hp, prevHP);
+      hc = counterDelta(ti.hc, prevHC);
+    }
+    tiStarted = true;
+    prevHP = ti.hp;
+    prevHC = ti.hc;
+  }
+  // The first call only takes the counters as reference
+  if (started) {
+    addGraphSample(counterDelta(prod, prevProd), hp, hc, counterDelta(vol, prevWater));
+  }
+  started = true;
+  prevProd = prod;
+  prevWater = vol;
+}
+
+// Apparent power of the last TeleInfo frame, one sample per second
+void recordLoad() {
+  TeleInfoData ti;
+  if (getTeleInfo(&ti)) {
+    addLoadSample(now(), ti.apparentPower);
+  }
+}
+
 // INSERT INTO EnergyMeters (Date,Maison) VALUES (2024-01-02,'12345');
 void recordEnergyMeter() {
   unsigned long indexHC = 0;
   unsigned long indexHP = 0;
-  char qry[400] = "";
+  TeleInfoDeltas ti;
+  int len;
+  char qry[800] = "";
   char msg[128] = "";
   if ((recordDone == true) && (hour() == 0) && (minute() == 15)) {
     recordDone = false;
@@ -502,28 +780,71 @@ void recordEnergyMeter() {
         water = 0;
 
         // Energy meter TI ***************************************************
-        // HC = 0x01
-        indexHC = readIndexTI(0x01);
-        sprintf(msg, "HC = %lu Wh", indexHC);
-        // Length   123456789ABCDFGHIJKL
-        addMessage(msg, ILI9341_CYAN);
-        // HP = 0x02
-        indexHP = readIndexTI(0x02);
-        sprintf(msg, "HP = %lu Wh", indexHP);
-        // Length   123456789ABCDFGHIJKL
-        addMessage(msg, ILI9341_CYAN);
+        // Every register of the contract from the same frame, the last one
+        // when the link is down: what is counted after it goes to the next day
+        if (!readDeltasTI(&ti)) {
+          if (ti.count == 0) {
+            // No frame since startup, the next rows cover this day too
+            skipDeltasTI();
+            // Length   123456789ABCDFGHIJKL
+            addMessage("No TeleInfo frame", ILI9341_RED);
+          }
+          else {
+            // Length   123456789ABCDFGHIJKL
+            addMessage("Old TeleInfo frame", ILI9341_ORANGE);
+          }
+        }
+        // Without any frame there is nothing to record, the connection is closed below
+        if (ti.count > 0) {
+          indexHC = ti.hc;
+          indexHP = ti.hp;
+          sprintf(msg, "HC = %lu Wh", indexHC);
+          // Length   123456789ABCDFGHIJKL
+          addMessage(msg, ILI9341_CYAN);
+          sprintf(msg, "HP = %lu Wh", indexHP);
+          // Length   123456789ABCDFGHIJKL
+          addMessage(msg, ILI9341_CYAN);
+          // EnergyMeters has one day per row, several days only go to EnergyRegisters
+          if (ti.days == 1) {
 #if FAKE
-    sprintf(qry, "UPDATE Domotic.Fake SET MaisonHC='%lu', Maison='%lu' WHERE Date = CURDATE() - INTERVAL 1 DAY;", indexHC, indexHP);
+            sprintf(qry, "UPDATE Domotic.Fake SET MaisonHC='%lu', Maison='%lu' WHERE Date = CURDATE() - INTERVAL 1 DAY;", indexHC, indexHP);
 #else
-    sprintf(qry, "UPDATE Domotic.EnergyMeters SET MaisonHC='%lu', Maison='%lu' WHERE Date = CURDATE() - INTERVAL 1 DAY;", indexHC, indexHP);
+            sprintf(qry, "UPDATE Domotic.EnergyMeters SET MaisonHC='%lu', Maison='%lu' WHERE Date = CURDATE() - INTERVAL 1 DAY;", indexHC, indexHP);
 #endif
-        if (!query_mem.execute(qry))  {
+            if (!query_mem.execute(qry))  {
+              // Length   123456789ABCDFGHIJKL
+              addMessage("Query error (Set HP/HC)", ILI9341_RED);
+              return;
+            }
+          }
+          else {
+            sprintf(msg, "HC/HP over %d days", ti.days);
+            // Length   123456789ABCDFGHIJKL
+            addMessage(msg, ILI9341_ORANGE);
+          }
+          // All the registers in one query, table EnergyRegisters:
+          // Date DATE, Register VARCHAR(8), Delta INT UNSIGNED, Reading INT UNSIGNED,
+          // Days TINYINT UNSIGNED (days the delta covers, ending at Date), PRIMARY KEY (Date, Register)
+#if FAKE
+          len = sprintf(qry, "INSERT INTO Domotic.FakeRegisters (Date, Register, Delta, Reading, Days) VALUES ");
+#else
+          len = sprintf(qry, "INSERT INTO Domotic.EnergyRegisters (Date, Register, Delta, Reading, Days) VALUES ");
+#endif
+          for (int i = 0; i < ti.count; i++) {
+            len += sprintf(qry + len, "%s(CURDATE() - INTERVAL 1 DAY, '%s', '%lu', '%lu', '%d')", (i > 0) ? ", " : "", ti.name[i], ti.delta[i], ti.current[i], ti.days);
+          }
+          sprintf(qry + len, " ON DUPLICATE KEY UPDATE Delta = VALUES(Delta), Reading = VALUES(Reading), Days = VALUES(Days);");
+          if (!query_mem.execute(qry))  {
+            // Length   123456789ABCDFGHIJKL
+            addMessage("Query error (Set registers)", ILI9341_RED);
+            return;
+          }
+          sprintf(msg, "%d TeleInfo registers", ti.count);
           // Length   123456789ABCDFGHIJKL
-          addMessage("Query error (Set HP/HC)", ILI9341_RED);
-          return;
+          addMessage(msg, ILI9341_CYAN);
+          // Reset all counters, to the indexes just recorded
+          resetDeltasTI(&ti);
         }
-        // Reset all counters
-        readIndexTI(0x32);
       }
       else {
         // Length   123456789ABCDFGHIJKL
@@ -538,23 +859,18 @@ void recordEnergyMeter() {
 }
 
 void synchronizeTime() {
-  int i = 0;
-  float latitude, longitude, altitude;
-  time_t gpsDT;
+  SIM7600Fix fix;
   char msg[128];
-  boolean gps_success = sim7600.getGPS(&latitude, &longitude, &gpsDT, &altitude);
-  while (!gps_success) {
-    if (i > 150) {
+  // Wait till the NMEA stream reports a fix, retry every 2s for 5 minutes
+  if (!sim7600.getFix(&fix) || (millis() - fix.updated > 3000)) {
+    if (tSyncGPS.getRunCounter() > 150) {
       doReboot();
     }
-    // Wait till we have a fix
-    delay(2000);
-    gps_success = sim7600.getGPS(&latitude, &longitude, &gpsDT, &altitude);
-    i++;
+    return;
   }
   addMessage("Sync date and time with GPS", ILI9341_GREEN);
   // Set Teensy time
-  setTime(hour(gpsDT), minute(gpsDT), second(gpsDT), day(gpsDT), month(gpsDT), year(gpsDT));
+  setTime(fix.pos.datetime + (millis() - fix.updated) / 1000);
   sprintf(msg, "%02d:%02d:%02d", hour(), minute(), second());
   addMessage(msg, ILI9341_GREEN);
   // Adjust DST last sunday of march
@@ -620,20 +936,6 @@ void taskDryTowel2Off() {
   digitalWrite(portB[6], LOW);
 }
 
-void sendSMS() {
-  if (strcmp(messageSMS, "") != 0) {
-    if (!sim7600.sendSMS(DENIS, messageSMS)) {
-      Serial.println("Failed");
-      addMessage("Failed to send SMS", ILI9341_RED);
-    }
-    else {
-      Serial.println(F("Sent!"));
-      addMessage("SMS Sent", ILI9341_GREEN);
-    }
-    messageSMS[0] = '\0';
-  }
-}
-
 char *decodeSMS(const char *number, const char *text) {
   int i;
   char *cmd;
@@ -650,8 +952,16 @@ char *decodeSMS(const char *number, const char *text) {
       }
     }
     else {
-      status = concat(0);
-      // Get status of ... TBD
+      // Get status of the energy meter
+      TeleInfoData ti;
+      char reply[80];
+      if (getTeleInfo(&ti)) {
+        snprintf(reply, sizeof(reply), "HC=%lu Wh HP=%lu Wh P=%lu VA", ti.hc, ti.hp, ti.apparentPower);
+      }
+      else {
+        snprintf(reply, sizeof(reply), "TeleInfo : no frame");
+      }
+      status = concat(1, reply);
 
       // Send back status
       return(status);
@@ -890,8 +1200,8 @@ void doReboot() {
 void setup() {
   Serial.begin(9600);
   Serial.println("Start");
-  // Energy meter, even parity, 7 bit data
-  Serial4.begin(1200, SERIAL_7E1);
+  // Energy meter, even parity, 7 bit data, 1200 or 9600 baud from the TIC mode
+  init_teleinfo();
 
   Serial4.addMemoryForRead(serial4buffer, sizeof(serial4buffer));
 
@@ -919,7 +1229,6 @@ void setup() {
   pinMode(emECS, INPUT);
   pinMode(emPAC, INPUT);
   pinMode(emAC, INPUT);
-  messageSMS[0] = '\0';
   // Init of timers
   prevAlarm1 = millis();
   prevAlarm2 = millis();
@@ -931,6 +1240,7 @@ void setup() {
   powerOnSensors();
   // Ethernet
   initEthernet();
+  diagServer.begin();
   // Update counters
   updateProd(cntProd);
   updatePAC(cntPAC);
@@ -941,20 +1251,35 @@ void setup() {
   // Set time to be 00:00:00 1-Jan-2024
   setTime(0, 0, 0, 1, 1, 24);
 
-  SIM7600Serial->begin(115200);
+  SIM7600Serial->addMemoryForRead(serial1buffer, sizeof(serial1buffer));
+  SIM7600Serial->begin(SIM7600_DEFAULT_BAUD);
   if (!sim7600.begin(*SIM7600Serial)) {
     // Length   123456789ABCDFGHIJKL
     addMessage("Can't find SIM7600 module", ILI9341_RED);
     while (1);
   }
+  sim7600.negotiateBaudrate(*SIM7600Serial, SIM7600_MAX_BAUD);
   
-  SIM7600Serial->print("AT+CNMI=2,1\r\n");  // Set up to send a +CMTI notification when an SMS is received
+  // Modem notifications
+  sim7600.onURC(F("+CMTI:"), onNewSMS);
+  sim7600.onURC(F("RING"), onModemEvent);
+  sim7600.onURC(F("+CLIP:"), onModemEvent);
+  sim7600.onURC(F("+CDS:"), onModemEvent);
+  sim7600.onURC(F("+CGPS:"), onModemEvent);
+  sim7600.onURC(F("+CREG:"), onModemEvent);
+  sim7600.onURC(F("+CGREG:"), onModemEvent);
+  sim7600.onURC(F("+CEREG:"), onModemEvent);
+
+  sim7600.setSMSRouting(2, 1);  // Set up to send a +CMTI notification when an SMS is received
 
   sim7600.enableGPS(true);
+  sim7600.reportNMEA(1);  // RMC, GGA and GSA every second, decoded by the driver
+  initOutbox(&sim7600);
 
   lux = 1000;
   // Task
   runner.startNow();
+  tModemStats.enableDelayed(TASK_HOUR);
   // Get GPS time
   tSyncGPS.enable();
 }
@@ -1010,6 +1335,18 @@ void loop() {
     counter4();
   }
   read_teleinfo();
+
+  // *************************************************************************************************
+  // Display page ************************************************************************************
+  if (pageButton.wasPressed()) {
+    graphPage = !graphPage;
+    if (graphPage) {
+      refreshGraph();
+    }
+    else {
+      refreshConsole();
+    }
+  }
   
   // Task
   runner.execute();
@@ -50,6 +50,10 @@
 #define _TASK_INLINE  // To avoid include it from more than one cpp
 
 #define FAKE false
+#define SIM7600_MAX_BAUD 921600  // Fastest modem link rate tried at startup
+#define DIAG_PORT 2323           // TCP port of the diagnostic commands
+#define TI_LINK_LOST 30000       // No TeleInfo frame for this long -> link lost, ms
+#define TI_LINK_ERRORS 5         // Bad TeleInfo lines over a minute -> link degraded, %
 
 char DENIS[] = "+33xxxxxxx";
 int water = 0;                         // Water volume measured
@@ -99,10 +103,18 @@ extern byte winterDSTMonth;
 
 void doReboot();
 void synchronizeTime();
-void sendSMS();
 void alarm();
 void sensors();
 void gsm();
+void onNewSMS(const char *urc, void *ctx);
+void onModemEvent(const char *urc, void *ctx);
+void modemPoll();
+void modemStats();
+void modemLink();
+void displayLoad();
+void teleInfoLink();
+void diagnostics();
+void snapshot();
 bool taskLightInsideOn();
 void taskLightInsideOff();
 bool taskLightOutsideOn();
@@ -122,6 +134,8 @@ int GetTokenCloseBraces(char *input, int index);
 char *substring(char *string, int position, int length);
 void initEthernet();
 void recordEnergyMeter();
+void recordGraph();
+void recordLoad();
 
 
 #endif
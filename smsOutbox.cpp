@@ -0,0 +1,149 @@
+#include <Arduino.h>
+#include <ILI9341_t3n.h>
+#include "smsOutbox.h"
+#include "display.h"
+
+#define SLOT_FREE     0
+#define SLOT_WAITING  1
+#define SLOT_SENDING  2
+
+typedef struct {
+  uint8_t state;
+  uint8_t priority;
+  uint8_t attempts;
+  uint32_t queuedAt;        // millis() when the message was queued
+  uint32_t nextTry;         // millis() of the next attempt
+  char number[OUTBOX_NUMBER_LENGTH + 1];
+  char text[OUTBOX_TEXT_LENGTH + 1];
+} OutboxEntry;
+
+OutboxEntry outbox[OUTBOX_SIZE];
+OutboxStats outboxStats;
+SIM7600 *outboxModem = NULL;
+bool outboxHeld = false;    // The modem is left to the inbox
+
+// ****************************************************************************
+// ******************************** Outbox ************************************
+// ****************************************************************************
+void initOutbox(SIM7600 *modem) {
+  outboxModem = modem;
+  memset(outbox, 0, sizeof(outbox));
+  memset(&outboxStats, 0, sizeof(outboxStats));
+}
+
+// Queue a message, an alarm may evict a queued status reply when the outbox is full
+bool queueSMS(const char *number, const char *text, uint8_t priority) {
+  int i;
+  int slot = -1;
+  for (i = 0; i < OUTBOX_SIZE; i++) {
+    if (outbox[i].state == SLOT_FREE) {
+      slot = i;
+      break;
+    }
+  }
+  if (slot < 0) {
+    // Evict the newest waiting message of lower priority
+    for (i = 0; i < OUTBOX_SIZE; i++) {
+      if ((outbox[i].state == SLOT_WAITING) && (outbox[i].priority > priority)) {
+        if ((slot < 0) || ((long)(outbox[i].queuedAt - outbox[slot].queuedAt) > 0)) {
+          slot = i;
+        }
+      }
+    }
+    outboxStats.dropped++;
+    if (slot < 0) {
+      return(false);
+    }
+    outboxStats.depth--;
+  }
+  outbox[slot].state = SLOT_WAITING;
+  outbox[slot].priority = priority;
+  outbox[slot].attempts = 0;
+  outbox[slot].queuedAt = millis();
+  outbox[slot].nextTry = outbox[slot].queuedAt;
+  strncpy(outbox[slot].number, number, OUTBOX_NUMBER_LENGTH);
+  outbox[slot].number[OUTBOX_NUMBER_LENGTH] = '\0';
+  strncpy(outbox[slot].text, text, OUTBOX_TEXT_LENGTH);
+  outbox[slot].text[OUTBOX_TEXT_LENGTH] = '\0';
+  outboxStats.queued++;
+  outboxStats.depth++;
+  if (outboxStats.depth > outboxStats.maxDepth) {
+    outboxStats.maxDepth = outboxStats.depth;
+  }
+  return(true);
+}
+
+// Called by the modem once the +CMGS reply is received or the send failed
+void onOutboxSent(uint8_t result, const char *reply, void *ctx) {
+  OutboxEntry *entry = (OutboxEntry *)ctx;
+  uint32_t backoff;
+  entry->attempts++;
+  if (result == SIM7600_CMD_OK) {
+    outboxStats.lastLatency = millis() - entry->queuedAt;
+    outboxStats.totalLatency += outboxStats.lastLatency;
+    if (outboxStats.lastLatency > outboxStats.maxLatency) {
+      outboxStats.maxLatency = outboxStats.lastLatency;
+    }
+    outboxStats.sent++;
+    outboxStats.depth--;
+    entry->state = SLOT_FREE;
+    Serial.println(F("Sent!"));
+    addMessage("SMS Sent", ILI9341_GREEN);
+  }
+  else if (entry->attempts >= OUTBOX_MAX_ATTEMPTS) {
+    outboxStats.failed++;
+    outboxStats.depth--;
+    entry->state = SLOT_FREE;
+    Serial.println("Failed");
+    addMessage("Failed to send SMS", ILI9341_RED);
+  }
+  else {
+    // Exponential backoff before next attempt
+    backoff = OUTBOX_BACKOFF_MS << (entry->attempts - 1);
+    if (backoff > OUTBOX_MAX_BACKOFF_MS) {
+      backoff = OUTBOX_MAX_BACKOFF_MS;
+    }
+    entry->nextTry = millis() + backoff;
+    entry->state = SLOT_WAITING;
+  }
+}
+
+// Task, hand the most urgent message to the modem, one at a time
+void drainOutbox() {
+  int i;
+  int slot = -1;
+  uint32_t now = millis();
+  if ((outboxModem == NULL) || outboxHeld) {
+    return;
+  }
+  for (i = 0; i < OUTBOX_SIZE; i++) {
+    if (outbox[i].state == SLOT_SENDING) {
+      return;
+    }
+    if ((outbox[i].state == SLOT_WAITING) && ((long)(now - outbox[i].nextTry) >= 0)) {
+      if ((slot < 0) || (outbox[i].priority < outbox[slot].priority)
+         || ((outbox[i].priority == outbox[slot].priority) && ((long)(outbox[i].queuedAt - outbox[slot].queuedAt) < 0))) {
+        slot = i;
+      }
+    }
+  }
+  if (slot < 0) {
+    return;
+  }
+  // Modem queue full, try again next time
+  if (outboxModem->sendSMSAsync(outbox[slot].number, outbox[slot].text, onOutboxSent, &outbox[slot])) {
+    if (outbox[slot].attempts > 0) {
+      outboxStats.retries++;
+    }
+    outbox[slot].state = SLOT_SENDING;
+  }
+}
+
+// No new message goes to the modem while held, the one being sent carries on
+void holdOutbox(bool hold) {
+  outboxHeld = hold;
+}
+
+const OutboxStats *getOutboxStats() {
+  return(&outboxStats);
+}
@@ -0,0 +1,37 @@
+#ifndef SMSOUTBOX_H
+#define SMSOUTBOX_H
+
+#include <Arduino.h>
+#include "SIM7600.h"
+
+#define OUTBOX_SIZE           8         // Messages waiting to be sent
+#define OUTBOX_NUMBER_LENGTH  20        // Longest recipient number
+#define OUTBOX_TEXT_LENGTH    160       // Longest message
+#define OUTBOX_MAX_ATTEMPTS   5         // Attempts before a message is given up
+#define OUTBOX_BACKOFF_MS     5000UL    // Delay before the first retry, doubled on each retry
+#define OUTBOX_MAX_BACKOFF_MS 300000UL  // Longest delay between two retries
+
+// Priorities, lowest value sent first
+#define SMS_PRIORITY_ALARM    0
+#define SMS_PRIORITY_STATUS   1
+
+typedef struct {
+  uint8_t depth;            // Messages currently queued
+  uint8_t maxDepth;         // Highest depth seen
+  uint32_t queued;          // Messages accepted
+  uint32_t sent;            // Messages delivered to the network
+  uint32_t failed;          // Messages given up after OUTBOX_MAX_ATTEMPTS
+  uint32_t dropped;         // Messages refused or evicted because the outbox was full
+  uint32_t retries;         // Send attempts after a failure
+  uint32_t lastLatency;     // Queue to +CMGS delay of the last message sent, ms
+  uint32_t maxLatency;      // Longest queue to +CMGS delay, ms
+  uint32_t totalLatency;    // Sum of the delays, divide by sent for the mean
+} OutboxStats;
+
+void initOutbox(SIM7600 *modem);
+bool queueSMS(const char *number, const char *text, uint8_t priority);
+void drainOutbox();
+void holdOutbox(bool hold);
+const OutboxStats *getOutboxStats();
+
+#endif
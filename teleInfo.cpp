@@ -1,27 +1,80 @@
 #include <TeleInfo.h>
+#include <EEPROM.h>
 #include "display.h"
 
 #define debtrame 0x02
+#define fintrame 0x03
+#define interruption 0x04
 #define debligne 0x0A
 #define finligne 0x0D
 
-volatile unsigned long prevHC = 0;
-volatile unsigned long prevHP = 0;
-volatile unsigned long currHC = 0;
-volatile unsigned long currHP = 0;
-
-volatile unsigned long index1 = 0;    // Index option Tempo - Heures Creuses Jours Bleus, Wh
-volatile unsigned long index2 = 0;    // Index option Tempo - Heures Pleines Jours Bleus, Wh
-volatile unsigned long index3 = 0;    // Index option Tempo - Heures Creuses Jours Blancs, Wh
-volatile unsigned long index4 = 0;    // Index option Tempo - Heures Pleines Jours Blancs, Wh
-volatile unsigned long index5 = 0;    // Index option Tempo - Heures Creuses Jours Rouges, Wh
-volatile unsigned long index6 = 0;    // Index option Tempo - Heures Pleines Jours Rouges, Wh
-
-byte inByte = 0;
-uint8_t presence_teleinfo = 0;  // si signal teleinfo présent
-char buffteleinfo[21] = "";
+#define TI_LINE_SIZE 128  // Longest line kept, LF to CR
+#define TI_CHUNK 64       // Bytes taken from Serial4 at once
+
+// Historic mode: 1200 baud, LF label SP data SP checksum CR
+// Standard mode: 9600 baud, LF label HT [date HT] data HT checksum CR
+#define TI_BAUD_HISTORIC 1200
+#define TI_BAUD_STANDARD 9600
+#define TI_SEARCH 10000   // Time without a valid line before trying the other rate, ms
+#define TI_STALE 10000    // Age of the last frame after which it is no longer valid, ms
+#define TI_RX_FULL (TI_RX_BUFFER - 1)  // Bytes waiting in Serial4 when it may have dropped some
+#define TI_EEPROM_ADDR 0  // Baselines of the daily deltas
+#define TI_EEPROM_MAGIC 0x54494232UL  // "TIB2"
+
+// Frame state machine
+#define TI_WAIT_FRAME 0   // Waiting for STX
+#define TI_WAIT_LINE 1    // In a frame, waiting for LF
+#define TI_IN_LINE 2      // In a line, waiting for CR
+
+// Registers of each contract (num_abo), historic labels also used in
+// standard mode; bit n of offPeak set when register n is heures creuses
+typedef struct {
+  uint8_t count;
+  uint8_t offPeak;
+  const char *name[TI_REGISTERS];
+}TiContract;
+
+const TiContract tiContracts[] = {
+  {0, 0x00, {0}},                                                                    // Unknown
+  {1, 0x00, {"BASE"}},                                                               // BASE
+  {2, 0x01, {"HCHC", "HCHP"}},                                                       // HC
+  {2, 0x00, {"EJPHN", "EJPHPM"}},                                                    // EJP
+  {6, 0x15, {"BBRHCJB", "BBRHPJB", "BBRHCJW", "BBRHPJW", "BBRHCJR", "BBRHPJR"}},     // Tempo
+};
+
+// Index of each register at the last reset of the daily deltas, kept in EEPROM
+typedef struct {
+  uint32_t magic;
+  uint8_t contract;
+  uint8_t missed;           // Days ended without a frame since the last reset
+  unsigned long baseline[TI_REGISTERS];
+}TiBaselines;
+
+TiBaselines tiBaselines;
+
+// Frame being received, its groups are written as their lines check out
+TeleInfoData tiFrame;
+bool tiFrameOk = false;     // Every line of the frame so far checked out
+uint8_t tiFrameLines = 0;
+uint8_t tiFrameContract = 0;  // Contract given by the frame (OPTARIF, NGTF), as num_abo
+uint8_t tiFrameSeen = 0;      // Bit n set when index[n] was in the frame
+
+// Last whole frame, double buffered: tiSeq is odd while tiBuffer[] is
+// written, the published frame is tiBuffer[(tiSeq >> 1) & 1]
+TeleInfoData tiBuffer[2];
+volatile uint32_t tiSeq = 0;
+
+TeleInfoStats tiStats;             // Link quality, lastValidAge filled on request
+uint32_t tiLastFrame = 0;          // Time of the last published frame
+
+char buffteleinfo[TI_LINE_SIZE];  // Line split over two reads
 byte bufflen = 0;
-byte num_abo = 0;
+byte tiState = TI_WAIT_FRAME;
+byte num_abo = 0;                  // Contract of the last published frame
+byte tiMode = TI_HISTORIC;         // Mode of the last valid line
+uint32_t tiBaud = TI_BAUD_HISTORIC;
+bool tiLocked = false;             // A valid line came at this rate
+uint32_t tiLastValid = 0;          // Time of the last valid line
 
 ///////////////////////////////////////////////////////////////////
 // Calculate Checksum
@@ -37,128 +90,558 @@ char chksum(char *buff, uint8_t len) {
 }
 
 ///////////////////////////////////////////////////////////////////
-// Analyse de la ligne de Teleinfo
+// Table des étiquettes, modes historique et standard
+// Each label gives what to do with its value and where to store it
 ///////////////////////////////////////////////////////////////////
-void traitbuf_cpt(char *buff, uint8_t len) {
-  char optarif[4] = "";    // BASE, HC, EJP BBRx options
+#define TI_IGNORE 0   // Known label, value not used
+#define TI_VALUE 1    // Index or power, stored in slot
+#define TI_OPTARIF 2  // Historic contract name
+#define TI_NGTF 3     // Standard contract name
+#define TI_NTARF 4    // Current tariff index
 
-  if (num_abo == 0) { // détermine le type d'abonnement
-    if (strncmp("OPTARIF ", &buff[1] , 8) == 0) {
-      strncpy(optarif, &buff[9], 3);
-      optarif[3]='\0';
-      if (strcmp("BAS", optarif) == 0) {
-        num_abo = 1;
-      }
-      else if (strcmp("HC.", optarif) == 0) {
-        num_abo = 2;
-      }
-      else if (strcmp("EJP", optarif) == 0) {
-        num_abo = 3;
+typedef struct {
+  const char *label;
+  uint8_t action;
+  unsigned long *slot;
+}TiLabel;
+
+constexpr TiLabel tiLabels[] = {
+  {"ADCO", TI_IGNORE, 0},
+  {"ADIR1", TI_IGNORE, 0},
+  {"ADIR2", TI_IGNORE, 0},
+  {"ADIR3", TI_IGNORE, 0},
+  {"ADPS", TI_IGNORE, 0},
+  {"ADSC", TI_IGNORE, 0},
+  {"BASE", TI_VALUE, &tiFrame.index[0]},
+  {"BBRHCJB", TI_VALUE, &tiFrame.index[0]},
+  {"BBRHCJR", TI_VALUE, &tiFrame.index[4]},
+  {"BBRHCJW", TI_VALUE, &tiFrame.index[2]},
+  {"BBRHPJB", TI_VALUE, &tiFrame.index[1]},
+  {"BBRHPJR", TI_VALUE, &tiFrame.index[5]},
+  {"BBRHPJW", TI_VALUE, &tiFrame.index[3]},
+  {"CCAIN", TI_IGNORE, 0},
+  {"CCAIN-1", TI_IGNORE, 0},
+  {"CCASN", TI_IGNORE, 0},
+  {"CCASN-1", TI_IGNORE, 0},
+  {"DATE", TI_IGNORE, 0},
+  {"DEMAIN", TI_IGNORE, 0},
+  {"DPM1", TI_IGNORE, 0},
+  {"DPM2", TI_IGNORE, 0},
+  {"DPM3", TI_IGNORE, 0},
+  {"EAIT", TI_IGNORE, 0},
+  {"EASD01", TI_IGNORE, 0},
+  {"EASD02", TI_IGNORE, 0},
+  {"EASD03", TI_IGNORE, 0},
+  {"EASD04", TI_IGNORE, 0},
+  {"EASF01", TI_VALUE, &tiFrame.index[0]},
+  {"EASF02", TI_VALUE, &tiFrame.index[1]},
+  {"EASF03", TI_VALUE, &tiFrame.index[2]},
+  {"EASF04", TI_VALUE, &tiFrame.index[3]},
+  {"EASF05", TI_VALUE, &tiFrame.index[4]},
+  {"EASF06", TI_VALUE, &tiFrame.index[5]},
+  {"EASF07", TI_IGNORE, 0},
+  {"EASF08", TI_IGNORE, 0},
+  {"EASF09", TI_IGNORE, 0},
+  {"EASF10", TI_IGNORE, 0},
+  {"EAST", TI_VALUE, &tiFrame.indexTotal},
+  {"EJPHN", TI_VALUE, &tiFrame.index[0]},
+  {"EJPHPM", TI_VALUE, &tiFrame.index[1]},
+  {"ERQ1", TI_IGNORE, 0},
+  {"ERQ2", TI_IGNORE, 0},
+  {"ERQ3", TI_IGNORE, 0},
+  {"ERQ4", TI_IGNORE, 0},
+  {"FPM1", TI_IGNORE, 0},
+  {"FPM2", TI_IGNORE, 0},
+  {"FPM3", TI_IGNORE, 0},
+  {"HCHC", TI_VALUE, &tiFrame.index[0]},
+  {"HCHP", TI_VALUE, &tiFrame.index[1]},
+  {"HHPHC", TI_IGNORE, 0},
+  {"IINST", TI_IGNORE, 0},
+  {"IINST1", TI_IGNORE, 0},
+  {"IINST2", TI_IGNORE, 0},
+  {"IINST3", TI_IGNORE, 0},
+  {"IMAX", TI_IGNORE, 0},
+  {"IMAX1", TI_IGNORE, 0},
+  {"IMAX2", TI_IGNORE, 0},
+  {"IMAX3", TI_IGNORE, 0},
+  {"IRMS1", TI_IGNORE, 0},
+  {"IRMS2", TI_IGNORE, 0},
+  {"IRMS3", TI_IGNORE, 0},
+  {"ISOUSC", TI_IGNORE, 0},
+  {"LTARF", TI_IGNORE, 0},
+  {"MOTDETAT", TI_IGNORE, 0},
+  {"MSG1", TI_IGNORE, 0},
+  {"MSG2", TI_IGNORE, 0},
+  {"NGTF", TI_NGTF, 0},
+  {"NJOURF", TI_IGNORE, 0},
+  {"NJOURF+1", TI_IGNORE, 0},
+  {"NTARF", TI_NTARF, 0},
+  {"OPTARIF", TI_OPTARIF, 0},
+  {"PAPP", TI_VALUE, &tiFrame.apparentPower},
+  {"PCOUP", TI_IGNORE, 0},
+  {"PEJP", TI_IGNORE, 0},
+  {"PJOURF+1", TI_IGNORE, 0},
+  {"PMAX", TI_IGNORE, 0},
+  {"PPOINTE", TI_IGNORE, 0},
+  {"PPOT", TI_IGNORE, 0},
+  {"PREF", TI_IGNORE, 0},
+  {"PRM", TI_IGNORE, 0},
+  {"PTEC", TI_IGNORE, 0},
+  {"RELAIS", TI_IGNORE, 0},
+  {"SINSTI", TI_IGNORE, 0},
+  {"SINSTS", TI_VALUE, &tiFrame.apparentPower},
+  {"SINSTS1", TI_IGNORE, 0},
+  {"SINSTS2", TI_IGNORE, 0},
+  {"SINSTS3", TI_IGNORE, 0},
+  {"SMAXIN", TI_IGNORE, 0},
+  {"SMAXIN-1", TI_IGNORE, 0},
+  {"SMAXSN", TI_IGNORE, 0},
+  {"SMAXSN-1", TI_IGNORE, 0},
+  {"SMAXSN1", TI_IGNORE, 0},
+  {"SMAXSN1-1", TI_IGNORE, 0},
+  {"SMAXSN2", TI_IGNORE, 0},
+  {"SMAXSN2-1", TI_IGNORE, 0},
+  {"SMAXSN3", TI_IGNORE, 0},
+  {"SMAXSN3-1", TI_IGNORE, 0},
+  {"STGE", TI_IGNORE, 0},
+  {"UMOYN1", TI_IGNORE, 0},
+  {"UMOYN2", TI_IGNORE, 0},
+  {"UMOYN3", TI_IGNORE, 0},
+  {"URMS1", TI_IGNORE, 0},
+  {"URMS2", TI_IGNORE, 0},
+  {"URMS3", TI_IGNORE, 0},
+  {"VTIC", TI_IGNORE, 0},
+};
+
+#define TI_LABELS (sizeof(tiLabels) / sizeof(tiLabels[0]))
+
+// Perfect hash of the labels: the length and five characters that tell
+// all labels apart, times a multiplier for which no two labels of
+// tiLabels share a slot; the top bits give the slot
+#define TI_HASH_MULT 0x52A3E8ABu
+#define TI_HASH_BITS 9
+#define TI_HASH_SIZE (1 << TI_HASH_BITS)
+#define TI_LABEL_MIN 3  // PRM
+
+constexpr uint16_t tiHash(const char *label, uint8_t len) {
+  uint32_t key = ((uint32_t)(uint8_t)label[0] | (uint32_t)(uint8_t)label[len >> 1] << 8 |
+                  (uint32_t)(uint8_t)label[len-3] << 16 | (uint32_t)(uint8_t)label[len-2] << 24) ^
+                 ((uint32_t)(uint8_t)label[len-1] << 4 | (uint32_t)len << 12);
+  return((key * TI_HASH_MULT) >> (32 - TI_HASH_BITS));
+}
+
+constexpr uint8_t tiLength(const char *label) {
+  uint8_t len = 0;
+  while (label[len] != '\0') len++;
+  return(len);
+}
+
+// Slot -> entry of tiLabels + 1, 0 when empty; built by the compiler
+typedef struct {
+  uint8_t entry[TI_HASH_SIZE];
+  bool perfect;
+}TiHashTable;
+
+constexpr TiHashTable tiBuildHash() {
+  TiHashTable t = {};
+  t.perfect = true;
+  for (uint8_t i = 0; i < TI_LABELS; i++) {
+    uint8_t len = tiLength(tiLabels[i].label);
+    if (len < TI_LABEL_MIN) {
+      t.perfect = false;
+      continue;
+    }
+    uint16_t h = tiHash(tiLabels[i].label, len);
+    if (t.entry[h] != 0) t.perfect = false;
+    t.entry[h] = i + 1;
+  }
+  return(t);
+}
+
+constexpr TiHashTable tiHashTable = tiBuildHash();
+static_assert(tiHashTable.perfect, "Two TeleInfo labels share a hash slot, change TI_HASH_MULT");
+
+///////////////////////////////////////////////////////////////////
+// Decimal value of a field, digits only
+///////////////////////////////////////////////////////////////////
+static unsigned long valeur(const char *s, uint8_t len) {
+  unsigned long v = 0;
+  while ((len-- > 0) && ((uint8_t)(*s - '0') < 10)) {
+    v = v * 10 + (*s++ - '0');
+  }
+  return(v);
+}
+
+///////////////////////////////////////////////////////////////////
+// True when a field holds a word
+///////////////////////////////////////////////////////////////////
+static bool contient(const char *s, uint8_t len, const char *word) {
+  uint8_t n = strlen(word);
+  for (uint8_t i = 0; i + n <= len; i++) {
+    if (memcmp(&s[i], word, n) == 0) return(true);
+  }
+  return(false);
+}
+
+///////////////////////////////////////////////////////////////////
+// Entry of a label taken from the line, 0 if unknown
+///////////////////////////////////////////////////////////////////
+static const TiLabel *chercheLabel(const char *label, uint8_t len) {
+  if (len < TI_LABEL_MIN) return(0);
+  uint8_t i = tiHashTable.entry[tiHash(label, len)];
+  if (i == 0) return(0);
+  const TiLabel *entry = &tiLabels[i - 1];
+  // Unknown labels land on any slot, the label itself must match
+  if ((strncmp(entry->label, label, len) != 0) || (entry->label[len] != '\0')) return(0);
+  return(entry);
+}
+
+///////////////////////////////////////////////////////////////////
+// Analyse d'un groupe, historique ou standard
+///////////////////////////////////////////////////////////////////
+void traitgroupe(const char *label, uint8_t labelLen, const char *value, uint8_t valueLen) {
+  const TiLabel *entry = chercheLabel(label, labelLen);
+  if (entry == 0) return;
+  switch (entry->action) {
+    case TI_VALUE :
+      *entry->slot = valeur(value, valueLen);
+      if ((entry->slot >= tiFrame.index) && (entry->slot < tiFrame.index + TI_REGISTERS)) {
+        tiFrameSeen |= 1 << (entry->slot - tiFrame.index);
       }
-      else if (strcmp("BBR", optarif) == 0) {
-        num_abo = 4;
+      break;
+    case TI_OPTARIF :
+      // BASE, HC.., EJP., BBRx
+      if (contient(value, valueLen, "BAS")) tiFrameContract = 1;
+      else if (contient(value, valueLen, "HC.")) tiFrameContract = 2;
+      else if (contient(value, valueLen, "EJP")) tiFrameContract = 3;
+      else if (contient(value, valueLen, "BBR")) tiFrameContract = 4;
+      break;
+    case TI_NGTF :
+      // Nom du calendrier tarifaire fournisseur, e.g. "H PLEINE/CREUSE"
+      if (contient(value, valueLen, "TEMPO")) tiFrameContract = 4;
+      else if (contient(value, valueLen, "EJP")) tiFrameContract = 3;
+      else if (contient(value, valueLen, "CREUSE") || contient(value, valueLen, "HC")) tiFrameContract = 2;
+      else if (contient(value, valueLen, "BASE")) tiFrameContract = 1;
+      break;
+    case TI_NTARF :
+      tiFrame.tariffIndex = valeur(value, valueLen);
+      break;
+  }
+}
+
+///////////////////////////////////////////////////////////////////
+// Index of a register since its baseline, the whole index when the
+// meter went back (meter replaced)
+///////////////////////////////////////////////////////////////////
+static unsigned long delta(unsigned long value, unsigned long baseline) {
+  return((value < baseline) ? value : value - baseline);
+}
+
+///////////////////////////////////////////////////////////////////
+// Deltas of every register of the contract of a frame
+///////////////////////////////////////////////////////////////////
+static void calcule_deltas(const TeleInfoData *ti, TeleInfoDeltas *d) {
+  const TiContract *contract = &tiContracts[(ti->contract < 5) ? ti->contract : 0];
+  bool known = (tiBaselines.magic == TI_EEPROM_MAGIC) && (tiBaselines.contract == ti->contract);
+  d->contract = ti->contract;
+  d->count = known ? contract->count : 0;
+  d->hc = 0;
+  d->hp = 0;
+  d->days = known ? tiBaselines.missed + 1 : 1;
+  for (uint8_t i = 0; i < d->count; i++) {
+    d->name[i] = contract->name[i];
+    d->baseline[i] = tiBaselines.baseline[i];
+    d->current[i] = ti->index[i];
+    d->delta[i] = delta(d->current[i], d->baseline[i]);
+    if (contract->offPeak & (1 << i)) d->hc += d->delta[i];
+    else d->hp += d->delta[i];
+  }
+}
+
+///////////////////////////////////////////////////////////////////
+// Publication d'une trame complète
+// Readers copy tiBuffer[] without locking and retry when the frame
+// they copied was rewritten meanwhile
+// A frame missing a register of its contract is not published, the
+// contract is taken again from every frame
+///////////////////////////////////////////////////////////////////
+static void publie_trame() {
+  uint32_t seq = tiSeq;
+  uint8_t target = ((seq >> 1) + 1) & 1;
+  const TiContract *contract = &tiContracts[(tiFrameContract < 5) ? tiFrameContract : 0];
+  uint8_t registers = (1 << contract->count) - 1;
+  if ((tiFrameSeen & registers) != registers) return;
+  num_abo = tiFrameContract;
+  tiFrame.hc = 0;
+  tiFrame.hp = 0;
+  for (uint8_t i = 0; i < contract->count; i++) {
+    if (contract->offPeak & (1 << i)) tiFrame.hc += tiFrame.index[i];
+    else tiFrame.hp += tiFrame.index[i];
+  }
+  tiFrame.contract = num_abo;
+  tiFrame.mode = tiMode;
+  tiFrame.valid = true;
+  tiFrame.frameTime = millis();
+  tiSeq = seq + 1;
+  __sync_synchronize();
+  tiBuffer[target] = tiFrame;
+  __sync_synchronize();
+  tiSeq = seq + 2;
+  tiLastFrame = tiFrame.frameTime;
+  if (contract->count == 0) return;
+  // First frame of this contract, the deltas start from it
+  if ((tiBaselines.magic != TI_EEPROM_MAGIC) || (tiBaselines.contract != num_abo)) {
+    tiBaselines.magic = TI_EEPROM_MAGIC;
+    tiBaselines.contract = num_abo;
+    tiBaselines.missed = 0;
+    memcpy(tiBaselines.baseline, tiFrame.index, sizeof(tiBaselines.baseline));
+    EEPROM.put(TI_EEPROM_ADDR, tiBaselines);
+  }
+  TeleInfoDeltas d;
+  calcule_deltas(&tiFrame, &d);
+  updateHC(d.hc);
+  updateHP(d.hp);
+}
+
+///////////////////////////////////////////////////////////////////
+// Dernière trame complète
+// Returns false when no frame came in the last TI_STALE ms
+///////////////////////////////////////////////////////////////////
+bool getTeleInfo(TeleInfoData *data) {
+  uint32_t seq;
+  do {
+    seq = tiSeq;
+    __sync_synchronize();
+    *data = tiBuffer[(seq >> 1) & 1];
+    __sync_synchronize();
+    // The writer only comes back to this buffer two publications later
+  } while (tiSeq - (seq & ~1UL) > 2);
+  data->age = millis() - data->frameTime;
+  if (data->age >= TI_STALE) data->valid = false;
+  return(data->valid);
+}
+
+///////////////////////////////////////////////////////////////////
+// Bad line, a link error only once the rate is known: at the wrong
+// rate every line is garbage
+///////////////////////////////////////////////////////////////////
+static void ligne_erronee(uint32_t *counter) {
+  if (tiLocked) (*counter)++;
+  else tiStats.searchErrors++;
+}
+
+///////////////////////////////////////////////////////////////////
+// Check and decode a whole line, LF to CR included
+// The separator before the checksum gives the mode
+// Returns false when the line does not check out
+///////////////////////////////////////////////////////////////////
+static bool traitligne(char *line, uint8_t len) {
+  if (len <= 5) {
+    ligne_erronee(&tiStats.checksumErrors);
+    return(false);
+  }
+  char *label = &line[1];
+  char *end = &line[len-3];
+  if (line[len-3] == ' ') {
+    // Historic, the checksum leaves out the last separator
+    if (chksum(line, len-1) == line[len-2]) { // Test du Checksum
+      char *value = (char *)memchr(label, ' ', end - label);
+      if (value != 0) {
+        tiMode = TI_HISTORIC;
+        tiLocked = true;
+        tiLastValid = millis();
+        tiStats.lines++;
+        traitgroupe(label, value - label, value + 1, end - value - 1); // ChekSum OK => Analyse de la Trame
+        return(true);
       }
     }
   }
-  else {
-    if (num_abo == 1) {
-      if (strncmp("BASE ", &buff[1] , 5) == 0) {
-          index1 = atol(&buff[6]);
+  else if (line[len-3] == '\t') {
+    // Standard, the checksum takes in the last separator
+    if (chksum(line, len) == line[len-2]) {
+      char *value = (char *)memchr(label, '\t', end - label);
+      if (value != 0) {
+        uint8_t labelLen = value - label;
+        value++;
+        // Horodated group: date HT value
+        char *next = (char *)memchr(value, '\t', end - value);
+        if (next != 0) value = next + 1;
+        tiMode = TI_STANDARD;
+        tiLocked = true;
+        tiLastValid = millis();
+        tiStats.lines++;
+        traitgroupe(label, labelLen, value, end - value);
+        return(true);
       }
     }
-    else if (num_abo == 2) {
-      if (strncmp("HCHP ", &buff[1] , 5) == 0) {
-          index2 = atol(&buff[6]);
-          currHP = index2;
-          updateHP(currHP - prevHP);
-      }
-      else if (strncmp("HCHC ", &buff[1] , 5) == 0) {
-          index1 = atol(&buff[6]);
-          currHC = index1;
-          updateHC(currHC - prevHC);
-      }
+  }
+  ligne_erronee(&tiStats.checksumErrors);
+  return(false);
+}
+
+///////////////////////////////////////////////////////////////////
+// Frame state machine over a block of received bytes
+// A line received in one block is checked where it is, only a line
+// split over two blocks is copied to buffteleinfo
+///////////////////////////////////////////////////////////////////
+void parse_teleinfo(char *data, uint16_t len) {
+  uint16_t i;
+  int16_t start = -1;  // LF of the current line in data, -1 -> line in buffteleinfo
+  for (i = 0; i < len; i++) {
+    char c = data[i] & 0x7F;
+    data[i] = c;
+    if (c == debtrame) {
+      tiState = TI_WAIT_LINE;
+      tiFrameOk = true;
+      tiFrameLines = 0;
+      // Nothing is kept from the previous frame
+      memset(&tiFrame, 0, sizeof(tiFrame));
+      tiFrameContract = 0;
+      tiFrameSeen = 0;
     }
-    else if (num_abo == 3) {
-      if (strncmp("EJPHN ", &buff[1] , 6) == 0) {
-          index1 = atol(&buff[7]);
-      }
-      else if (strncmp("EJPHPM ", &buff[1] , 7) == 0) {
-          index2 = atol(&buff[8]);
-      }
+    else if (c == fintrame) {
+      // Published only when all its lines checked out
+      if (tiState != TI_WAIT_FRAME) tiStats.frames++;
+      if ((tiState == TI_WAIT_LINE) && tiFrameOk && (tiFrameLines > 0)) publie_trame();
+      tiState = TI_WAIT_FRAME;
     }
-    else if (num_abo == 4) {
-      if (strncmp("BBRHCJB ", &buff[1] , 8) == 0) {
-          index1 = atol(&buff[9]);
-      }
-      else if (strncmp("BBRHPJB ", &buff[1] , 8) == 0) {
-          index2 = atol(&buff[9]);
-      }
-      else if (strncmp("BBRHCJW ", &buff[1] , 8) == 0) {
-          index3 = atol(&buff[9]);
+    else if (c == interruption) {
+      tiState = TI_WAIT_FRAME;
+    }
+    else if (c == debligne) {
+      if (tiState != TI_WAIT_FRAME) {
+        tiState = TI_IN_LINE;
+        start = i;
+        bufflen = 0;
       }
-      else if (strncmp("BBRHPJW ", &buff[1] , 8) == 0) {
-          index4 = atol(&buff[9]);
+    }
+    else if (tiState == TI_IN_LINE) {
+      if ((start >= 0) && (i - start >= TI_LINE_SIZE)) {
+        // Too long, not a TeleInfo line
+        tiState = TI_WAIT_LINE;
+        tiFrameOk = false;
+        ligne_erronee(&tiStats.overlongLines);
       }
-      else if (strncmp("BBRHCJR ", &buff[1] , 8) == 0) {
-          index5 = atol(&buff[9]);
+      else if (start < 0) {
+        if (bufflen >= TI_LINE_SIZE) {
+          tiState = TI_WAIT_LINE;
+          tiFrameOk = false;
+          ligne_erronee(&tiStats.overlongLines);
+          continue;
+        }
+        buffteleinfo[bufflen++] = c;
+        if (c == finligne) {
+          if (!traitligne(buffteleinfo, bufflen)) tiFrameOk = false;
+          tiFrameLines++;
+          tiState = TI_WAIT_LINE;
+        }
       }
-      else if (strncmp("BBRHPJR ", &buff[1] , 8) == 0) {
-          index6 = atol(&buff[9]);
+      else if (c == finligne) {
+        if (!traitligne(&data[start], i - start + 1)) tiFrameOk = false;
+        tiFrameLines++;
+        tiState = TI_WAIT_LINE;
       }
     }
   }
+  // The line goes on in the next block
+  if ((tiState == TI_IN_LINE) && (start >= 0)) {
+    bufflen = len - start;
+    memcpy(buffteleinfo, &data[start], bufflen);
+  }
 }
 
 ///////////////////////////////////////////////////////////////////
-// Lecture trame teleinfo (ligne par ligne)
-/////////////////////////////////////////////////////////////////// 
-void read_teleinfo()
-{
-  presence_teleinfo++;
-  if (presence_teleinfo > 250) presence_teleinfo = 0;
-  // si une donnée est dispo sur le port série
-  if (Serial4.available() > 0) 
-  {
-    presence_teleinfo = 0;
-    // recupère le caractère dispo
-    inByte = Serial4.read();
-    inByte = inByte & 0x7F;
-
-    if (inByte == debtrame) bufflen = 0; // test le début de trame
-    if (inByte == debligne) // test si c'est le caractère de début de ligne
-    {
-      bufflen = 0;
-    }  
-    buffteleinfo[bufflen] = inByte;
-    bufflen++;
-    if (bufflen > 21) {
-      bufflen = 0;
-    }
-    if (inByte == finligne && bufflen > 5) // si Fin de ligne trouvée 
-    {
-      if (chksum(buffteleinfo, bufflen-1) == buffteleinfo[bufflen-2]) // Test du Checksum
-      {
-        traitbuf_cpt(buffteleinfo, bufflen-1); // ChekSum OK => Analyse de la Trame
-      }
-    }
-  } 
+// Erreurs de réception de l'UART
+// Serial4 is LPUART3 on the Teensy 4.1; its flags only tell that at
+// least one error happened since the last poll
+///////////////////////////////////////////////////////////////////
+static void erreurs_uart() {
+#if defined(__IMXRT1062__)
+  const uint32_t w1c = LPUART_STAT_LBKDIF | LPUART_STAT_RXEDGIF | LPUART_STAT_IDLE | LPUART_STAT_OR |
+                       LPUART_STAT_NF | LPUART_STAT_FE | LPUART_STAT_PF | LPUART_STAT_MA1F | LPUART_STAT_MA2F;
+  uint32_t stat = LPUART3_STAT;
+  uint32_t errors = stat & (LPUART_STAT_OR | LPUART_STAT_NF | LPUART_STAT_FE | LPUART_STAT_PF);
+  if (errors == 0) return;
+  if ((errors & (LPUART_STAT_NF | LPUART_STAT_FE | LPUART_STAT_PF)) && tiLocked) tiStats.parityErrors++;
+  if (errors & LPUART_STAT_OR) tiStats.overruns++;
+  // Write 1 to clear the error flags only, the other flags are kept
+  LPUART3_STAT = (stat & ~w1c) | errors;
+#endif
 }
 
-unsigned long readIndexTI(int channel) {
-  // Get HC
-  if (channel == 0x01) {
-    unsigned long ind = currHC - prevHC;
-    return(ind);
+///////////////////////////////////////////////////////////////////
+// Lecture trame teleinfo, tout ce qui est disponible sur le port série
+///////////////////////////////////////////////////////////////////
+void read_teleinfo()
+{
+  char block[TI_CHUNK];
+  int n;
+  erreurs_uart();
+  // Receive buffer full, bytes were dropped by the serial driver
+  if (Serial4.available() >= TI_RX_FULL) tiStats.overruns++;
+  while ((n = Serial4.available()) > 0) {
+    n = Serial4.readBytes(block, min(n, TI_CHUNK));
+    parse_teleinfo(block, n);
   }
-  // Get HP
-  else if (channel == 0x02) {
-    unsigned long ind = currHP - prevHP;
-    return(ind);
+  // No valid line at this rate, the meter may be in the other mode
+  if (millis() - tiLastValid > TI_SEARCH) {
+    tiBaud = (tiBaud == TI_BAUD_HISTORIC) ? TI_BAUD_STANDARD : TI_BAUD_HISTORIC;
+    Serial4.begin(tiBaud, SERIAL_7E1);
+    tiState = TI_WAIT_FRAME;
+    tiLocked = false;
+    tiLastValid = millis();
   }
-  // Reset all
-  else if (channel == 0x32) {
-    prevHC = currHC;
-    prevHP = currHP;
+}
+
+///////////////////////////////////////////////////////////////////
+// Qualité de la liaison
+///////////////////////////////////////////////////////////////////
+void getTeleInfoStats(TeleInfoStats *stats) {
+  *stats = tiStats;
+  stats->lastValidAge = millis() - tiLastFrame;
+}
+
+///////////////////////////////////////////////////////////////////
+// Port série du compteur, mode historique par défaut
+///////////////////////////////////////////////////////////////////
+void init_teleinfo() {
+  EEPROM.get(TI_EEPROM_ADDR, tiBaselines);
+  tiBaud = TI_BAUD_HISTORIC;
+  Serial4.begin(tiBaud, SERIAL_7E1);
+  tiLastValid = millis();
+}
+
+///////////////////////////////////////////////////////////////////
+// Deltas of all the registers since the last reset, from one frame
+// Returns false when there is no recent frame or no baseline yet; the
+// deltas are still those of the last frame when it is only old
+///////////////////////////////////////////////////////////////////
+bool readDeltasTI(TeleInfoDeltas *d) {
+  TeleInfoData ti;
+  bool valid = getTeleInfo(&ti);
+  calcule_deltas(&ti, d);
+  return(valid && (d->count > 0));
+}
+
+///////////////////////////////////////////////////////////////////
+// New day: the indexes read in d become the baselines
+// The deltas counted since d was read are kept for the next day
+///////////////////////////////////////////////////////////////////
+void resetDeltasTI(const TeleInfoDeltas *d) {
+  if ((d->count == 0) || (d->contract != tiBaselines.contract)) return;
+  for (uint8_t i = 0; i < d->count; i++) {
+    tiBaselines.baseline[i] = d->current[i];
   }
-  return(0);
+  tiBaselines.missed = 0;
+  EEPROM.put(TI_EEPROM_ADDR, tiBaselines);
+}
+
+///////////////////////////////////////////////////////////////////
+// New day without any frame: the baselines are kept and the next
+// deltas tell how many days they cover
+///////////////////////////////////////////////////////////////////
+void skipDeltasTI() {
+  if ((tiBaselines.magic != TI_EEPROM_MAGIC) || (tiBaselines.missed == 0xFF)) return;
+  tiBaselines.missed++;
+  EEPROM.put(TI_EEPROM_ADDR, tiBaselines);
 }
\ No newline at end of file
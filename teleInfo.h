@@ -3,9 +3,62 @@
 
 #include <Arduino.h>
 
+// TIC mode
+#define TI_HISTORIC 0
+#define TI_STANDARD 1
+
+#define TI_RX_BUFFER 2000  // Memory added to the Serial4 receive buffer
+#define TI_REGISTERS 6     // Most index registers of a contract (Tempo)
+
+// Link quality, counted since startup
+typedef struct {
+  uint32_t frames;          // Frames received, STX to ETX
+  uint32_t lines;           // Lines whose checksum checked out
+  uint32_t checksumErrors;  // Lines with a wrong checksum or layout
+  uint32_t overlongLines;   // Lines longer than the line buffer
+  uint32_t searchErrors;    // Bad lines while the rate was searched, not in the two above
+  uint32_t parityErrors;    // Polls that found a parity, framing or noise error, rate locked
+  uint32_t overruns;        // Polls that found a UART overrun or the receive buffer full
+  uint32_t lastValidAge;    // Time since the last frame whose lines all checked out, ms
+}TeleInfoStats;
+
+// Values of one whole frame whose lines all checked out
+typedef struct {
+  unsigned long index[TI_REGISTERS];  // Index 1..6: BASE, HC/HP, EJP HN/HPM, Tempo HC/HP bleu, blanc, rouge, Wh
+  unsigned long indexTotal;     // Energie active soutiree totale (EAST), Wh
+  unsigned long hc;             // Sum of the heures creuses registers, Wh
+  unsigned long hp;             // Sum of the other registers, Wh
+  unsigned long apparentPower;  // Puissance apparente (PAPP, SINSTS), VA
+  uint8_t tariffIndex;          // Index tarifaire en cours (NTARF)
+  uint8_t contract;             // 0 unknown, 1 BASE, 2 HC, 3 EJP, 4 Tempo
+  uint8_t mode;                 // TI_HISTORIC or TI_STANDARD
+  bool valid;                   // A frame was received less than 10 s ago
+  uint32_t frameTime;           // millis() at the end of the frame
+  uint32_t age;                 // Time since the end of the frame, ms
+}TeleInfoData;
+
+// Daily consumption of each register of the contract
+typedef struct {
+  uint8_t contract;                     // As TeleInfoData
+  uint8_t count;                        // Registers, 0 until the first frame of the contract
+  const char *name[TI_REGISTERS];       // Historic label of the register
+  unsigned long baseline[TI_REGISTERS]; // Index at the last reset, Wh
+  unsigned long current[TI_REGISTERS];  // Index of the frame, Wh
+  unsigned long delta[TI_REGISTERS];    // Since the last reset, Wh
+  unsigned long hc;                     // Sum of the heures creuses deltas, Wh
+  unsigned long hp;                     // Sum of the other deltas, Wh
+  uint8_t days;                         // Days since the last reset, more than 1 after a missed day
+}TeleInfoDeltas;
+
 char chksum(char *buff, uint8_t len);
-void traitbuf_cpt(char *buff, uint8_t len);
+void traitgroupe(const char *label, uint8_t labelLen, const char *value, uint8_t valueLen);
 void read_teleinfo();
-unsigned long readIndexTI(int channel);
+void parse_teleinfo(char *data, uint16_t len);
+void init_teleinfo();
+bool getTeleInfo(TeleInfoData *data);
+void getTeleInfoStats(TeleInfoStats *stats);
+bool readDeltasTI(TeleInfoDeltas *d);
+void resetDeltasTI(const TeleInfoDeltas *d);
+void skipDeltasTI();
 
 #endif
\ No newline at end of file
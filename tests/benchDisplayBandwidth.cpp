@@ -0,0 +1,60 @@
+/*
+ * Bytes sent to the LCD for a minute of the dashboard, against one whole
+ * framebuffer (153,600 bytes) per update call as each helper used to
+ * end with tft.updateScreen()
+ * alarm() runs every 100 ms: updateTime(), updateWater(), updateLux();
+ * the counters change once a second, a console line every 10 s
+ */
+#include "ILI9341_t3n.h"
+#include "display.h"
+
+#define SECONDS 60
+#define FULL_FRAME (ILI9341_TFTWIDTH * ILI9341_TFTHEIGHT * 2)
+
+int main() {
+  ILI9341_t3n *lcd;
+  uint32_t calls = 0;
+  uint64_t start;
+  int water = 0;
+  char text[40];
+
+  initDisplay();
+  lcd = ILI9341_t3n::lcd;
+  hostMillis += 1000;
+  serviceDisplay();
+  start = lcd->pixelBytes;
+
+  for (int ms = 0; ms < SECONDS * 1000; ms += 10) {
+    if (ms % 100 == 0) {
+      if (ms % 2000 == 0) water++;
+      updateTime();
+      updateWater(water);
+      updateLux(120, 250);
+      calls += 3;
+    }
+    if (ms % 1000 == 0) {
+      updateProd(ms / 100);
+      updateHC(ms / 1000);
+      updateHP(ms / 300);
+      updateAC(ms / 700);
+      calls += 4;
+    }
+    if (ms % 10000 == 0) {
+      snprintf(text, sizeof(text), "Message at %d s", ms / 1000);
+      addMessage(text, ILI9341_GREEN);
+      calls++;
+    }
+    serviceDisplay();
+    hostMillis += 10;
+  }
+
+  uint64_t before = (uint64_t)calls * FULL_FRAME / SECONDS;
+  uint64_t after = (lcd->pixelBytes - start) / SECONDS;
+  printf("benchDisplayBandwidth: %u update calls in %d s\n", (unsigned)calls, SECONDS);
+  // More than the bus carries: each updateScreen() blocked until the next one could start
+  printf("  whole framebuffer per call: %9llu bytes/s asked, %llu sent, SPI at 30 MHz busy %5.1f%%\n",
+         (unsigned long long)before, (unsigned long long)min(before, (uint64_t)(30e6 / 8)), min(before * 8 / 30e6, 1.0) * 100);
+  printf("  dirty rectangles:           %9llu bytes/s,           SPI at 30 MHz busy %5.1f%%\n",
+         (unsigned long long)after, after * 8 / 30e6 * 100);
+  return 0;
+}
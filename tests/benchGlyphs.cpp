@@ -0,0 +1,103 @@
+/*
+ * Drawing a dashboard value: the glyph cache against the font path the
+ * update functions used, fillRect() then print() at text size 2
+ * millis() does not move, no frame goes out: only the drawing is timed,
+ * sending is in benchDisplayBandwidth. The font path runs on a second
+ * LCD model whose framebuffer is then compared with the sketch one
+ */
+#include <chrono>
+#include "hostTest.h"
+#include "ILI9341_t3n.h"
+#include "TimeLib.h"
+#include "display.h"
+
+#define ROUNDS 20000
+#define RUNS 5     // The best one is kept
+
+static double nsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The cell of a widget is the same on both LCDs
+static bool sameCell(ILI9341_t3n *a, ILI9341_t3n *b, int16_t x, int16_t y, int16_t w, int16_t h) {
+  for (int16_t row = y; row < y + h; row++) {
+    for (int16_t col = x; col < min(x + w, ILI9341_TFTWIDTH); col++) {
+      int i = row * ILI9341_TFTWIDTH + col;
+      if (a->getFrameBuffer()[i] != b->getFrameBuffer()[i]) return false;
+    }
+  }
+  return true;
+}
+
+static void printProd(ILI9341_t3n &tft, int prod) {
+  tft.setCursor(170, 17);
+  tft.setTextColor(C_EMETER);
+  tft.setTextSize(2);
+  tft.fillRect(170, 16, 72, 16, C_BACKGROUND);
+  tft.print(prod);
+}
+
+static void printTime(ILI9341_t3n &tft) {
+  char text[12];
+  tft.setCursor(0, 0);
+  tft.setTextColor(C_TIME);
+  tft.setTextSize(2);
+  tft.fillRect(0, 0, 120, 14, C_BACKGROUNDTIMEDATE);
+  snprintf(text, sizeof(text), "%02d:%02d:%02d", hour(), minute(), second());
+  tft.print(text);
+}
+
+int main() {
+  std::chrono::steady_clock::time_point start;
+  double cached = 1e9, font = 1e9;
+  time_t t0;
+  int seconds = 0;
+
+  initDisplay();
+  hostMillis += 1000;
+  serviceDisplay();
+  ILI9341_t3n *lcd = ILI9341_t3n::lcd;
+  ILI9341_t3n old(10, 9);
+  old.useFrameBuffer(1);
+  memcpy(old.getFrameBuffer(), lcd->getFrameBuffer(), ILI9341_TFTWIDTH * ILI9341_TFTHEIGHT * 2);
+
+  // Production counter, a new value each time, at most 5 digits: the font
+  // path wraps a 6th one to the next line
+  for (int run = 0; run < RUNS; run++) {
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; i++) {
+      updateProd(i * 3);
+      serviceDisplay();
+    }
+    cached = min(cached, nsSince(start) / ROUNDS);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; i++) printProd(old, i * 3);
+    font = min(font, nsSince(start) / ROUNDS);
+  }
+  CHECK(sameCell(lcd, &old, 170, 16, 72, 17));
+  printf("benchGlyphs: production  cached %7.0f ns, font %7.0f ns, x%.1f\n", cached, font, font / cached);
+
+  // Clock, a new second each time
+  t0 = now();
+  cached = font = 1e9;
+  for (int run = 0; run < RUNS; run++) {
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; i++) {
+      setTime(t0 + ++seconds);
+      updateTime();
+      serviceDisplay();
+    }
+    cached = min(cached, nsSince(start) / ROUNDS);
+    seconds -= ROUNDS;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; i++) {
+      setTime(t0 + ++seconds);
+      printTime(old);
+    }
+    font = min(font, nsSince(start) / ROUNDS);
+  }
+  CHECK(sameCell(lcd, &old, 0, 0, 120, 16));
+  printf("benchGlyphs: clock       cached %7.0f ns, font %7.0f ns, x%.1f\n", cached, font, font / cached);
+
+  return testResult("benchGlyphs");
+}
@@ -0,0 +1,215 @@
+/*
+ * Cost of the label dispatch of a checked line, ns per line: the hashed
+ * table of traitgroupe() against the strncmp cascade it replaced
+ * (traitbuf_cpt(), historic mode only, copied below). For the standard
+ * mode, which the cascade never read, it is set against the same cascade
+ * written for the labels kept from a standard frame
+ * Frames as the meters send them, every line is dispatched, read or not
+ */
+#include <chrono>
+#include <string>
+#include <vector>
+#include "TeleInfo.h"
+
+#define ROUNDS 200000
+#define RUNS 5     // The best one is kept
+
+extern byte num_abo;
+
+void updateHC(int hc) {}
+void updateHP(int hp) {}
+
+// The cascade, as it was *************************************************************
+unsigned long index1, index2, index3, index4, index5, index6;
+unsigned long currHC, currHP, prevHC, prevHP;
+
+void traitbuf_cpt(char *buff, uint8_t len) {
+  char optarif[4] = "";    // BASE, HC, EJP BBRx options
+
+  if (num_abo == 0) { // détermine le type d'abonnement
+    if (strncmp("OPTARIF ", &buff[1] , 8) == 0) {
+      strncpy(optarif, &buff[9], 3);
+      optarif[3]='\0';
+      if (strcmp("BAS", optarif) == 0) {
+        num_abo = 1;
+      }
+      else if (strcmp("HC.", optarif) == 0) {
+        num_abo = 2;
+      }
+      else if (strcmp("EJP", optarif) == 0) {
+        num_abo = 3;
+      }
+      else if (strcmp("BBR", optarif) == 0) {
+        num_abo = 4;
+      }
+    }
+  }
+  else {
+    if (num_abo == 1) {
+      if (strncmp("BASE ", &buff[1] , 5) == 0) {
+          index1 = atol(&buff[6]);
+      }
+    }
+    else if (num_abo == 2) {
+      if (strncmp("HCHP ", &buff[1] , 5) == 0) {
+          index2 = atol(&buff[6]);
+          currHP = index2;
+          updateHP(currHP - prevHP);
+      }
+      else if (strncmp("HCHC ", &buff[1] , 5) == 0) {
+          index1 = atol(&buff[6]);
+          currHC = index1;
+          updateHC(currHC - prevHC);
+      }
+    }
+    else if (num_abo == 3) {
+      if (strncmp("EJPHN ", &buff[1] , 6) == 0) {
+          index1 = atol(&buff[7]);
+      }
+      else if (strncmp("EJPHPM ", &buff[1] , 7) == 0) {
+          index2 = atol(&buff[8]);
+      }
+    }
+    else if (num_abo == 4) {
+      if (strncmp("BBRHCJB ", &buff[1] , 8) == 0) {
+          index1 = atol(&buff[9]);
+      }
+      else if (strncmp("BBRHPJB ", &buff[1] , 8) == 0) {
+          index2 = atol(&buff[9]);
+      }
+      else if (strncmp("BBRHCJW ", &buff[1] , 8) == 0) {
+          index3 = atol(&buff[9]);
+      }
+      else if (strncmp("BBRHPJW ", &buff[1] , 8) == 0) {
+          index4 = atol(&buff[9]);
+      }
+      else if (strncmp("BBRHCJR ", &buff[1] , 8) == 0) {
+          index5 = atol(&buff[9]);
+      }
+      else if (strncmp("BBRHPJR ", &buff[1] , 8) == 0) {
+          index6 = atol(&buff[9]);
+      }
+    }
+  }
+}
+
+// The same cascade for the labels kept from a standard frame
+unsigned long indexTotal, apparentPower;
+unsigned long indexes[10];
+uint8_t tariffIndex;
+
+void traitbuf_std(char *buff, uint8_t len) {
+  if (strncmp("EAST\t", &buff[1], 5) == 0) {
+    indexTotal = atol(&buff[6]);
+  }
+  else if (strncmp("EASF0", &buff[1], 5) == 0) {
+    if ((buff[6] >= '1') && (buff[6] <= '6')) indexes[buff[6] - '1'] = atol(&buff[8]);
+  }
+  else if (strncmp("SINSTS\t", &buff[1], 7) == 0) {
+    apparentPower = atol(&buff[8]);
+  }
+  else if (strncmp("NTARF\t", &buff[1], 6) == 0) {
+    tariffIndex = atol(&buff[7]);
+  }
+  else if (strncmp("NGTF\t", &buff[1], 5) == 0) {
+    if (strstr(&buff[6], "TEMPO")) num_abo = 4;
+    else if (strstr(&buff[6], "EJP")) num_abo = 3;
+    else if (strstr(&buff[6], "CREUSE")) num_abo = 2;
+    else if (strstr(&buff[6], "BASE")) num_abo = 1;
+  }
+}
+
+// Frames *****************************************************************************
+typedef struct {
+  const char *label, *date, *value;
+}Group;
+
+typedef struct {
+  const char *name;
+  char separator;
+  uint8_t contract;
+  std::vector<Group> groups;
+}Frame;
+
+// Line LF label SEP [date SEP] value SEP checksum CR, without its CR, as the
+// cascade got it
+static std::string line(const Group &g, char separator) {
+  std::string body = std::string(g.label) + separator + (g.date ? std::string(g.date) + separator : "") + g.value;
+  std::string checked = (separator == '\t') ? body + separator : body;
+  int sum = 0;
+  for (char c : checked) sum += c;
+  return "\n" + body + separator + (char)((sum & 0x3F) + 0x20);
+}
+
+static double nsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  const std::vector<Group> head = {{"ADCO", 0, "021728123456"}};
+  const std::vector<Group> tail = {{"IINST", 0, "008"}, {"IMAX", 0, "090"}, {"PAPP", 0, "01890"},
+                                   {"HHPHC", 0, "A"}, {"MOTDETAT", 0, "000000"}};
+  std::vector<Frame> frames = {
+    {"BASE", ' ', 1, {{"OPTARIF", 0, "BASE"}, {"ISOUSC", 0, "45"}, {"BASE", 0, "012345678"}, {"PTEC", 0, "TH.."}}},
+    {"HC", ' ', 2, {{"OPTARIF", 0, "HC.."}, {"ISOUSC", 0, "45"}, {"HCHC", 0, "012345678"}, {"HCHP", 0, "023456789"},
+                    {"PTEC", 0, "HP.."}}},
+    {"EJP", ' ', 3, {{"OPTARIF", 0, "EJP."}, {"ISOUSC", 0, "45"}, {"EJPHN", 0, "012345678"}, {"EJPHPM", 0, "023456789"},
+                     {"PEJP", 0, "30"}, {"PTEC", 0, "HN.."}}},
+    {"TEMPO", ' ', 4, {{"OPTARIF", 0, "BBR("}, {"ISOUSC", 0, "45"}, {"BBRHCJB", 0, "012345678"}, {"BBRHPJB", 0, "023456789"},
+                       {"BBRHCJW", 0, "000123456"}, {"BBRHPJW", 0, "000234567"}, {"BBRHCJR", 0, "000012345"},
+                       {"BBRHPJR", 0, "000023456"}, {"PTEC", 0, "HPJB"}, {"DEMAIN", 0, "----"}}},
+  };
+  for (Frame &f : frames) {
+    f.groups.insert(f.groups.begin(), head.begin(), head.end());
+    f.groups.insert(f.groups.end(), tail.begin(), tail.end());
+  }
+  Frame standardFrame = {"TEMPO", '\t', 4, {{"ADSC", 0, "041876097467"}, {"VTIC", 0, "02"},
+                         {"DATE", "H240115143015", ""}, {"NGTF", 0, "     TEMPO      "}, {"LTARF", 0, "    HP  BLEU    "},
+                         {"EAST", 0, "003810639"}}};
+  static char easf[10][8];
+  for (int i = 0; i < 10; i++) {
+    snprintf(easf[i], sizeof(easf[i]), "EASF%02d", i + 1);
+    standardFrame.groups.push_back({easf[i], 0, "001000000"});
+  }
+  const std::vector<Group> standardTail = {{"EASD01", 0, "003810639"}, {"IRMS1", 0, "004"}, {"URMS1", 0, "231"},
+    {"PREF", 0, "09"}, {"PCOUP", 0, "09"}, {"SINSTS", 0, "01890"}, {"SMAXSN", "H240115083012", "04102"},
+    {"SMAXSN-1", "H240114193044", "05544"}, {"CCASN", "H240115143000", "00930"}, {"UMOYN1", "H240115143000", "229"},
+    {"STGE", 0, "003A0001"}, {"MSG1", 0, "PAS DE          MESSAGE         "}, {"PRM", 0, "12345678901234"},
+    {"RELAIS", 0, "000"}, {"NTARF", 0, "01"}, {"NJOURF", 0, "00"}, {"NJOURF+1", 0, "00"}};
+  standardFrame.groups.insert(standardFrame.groups.end(), standardTail.begin(), standardTail.end());
+  frames.push_back(standardFrame);
+
+  printf("benchTeleInfoDispatch: ns per line, best of %d runs of %d frames\n", RUNS, ROUNDS);
+  for (const Frame &f : frames) {
+    std::vector<std::string> lines;
+    std::vector<uint8_t> labelLen, valueAt;
+    for (const Group &g : f.groups) {
+      lines.push_back(line(g, f.separator));
+      labelLen.push_back(strlen(g.label));
+      valueAt.push_back(lines.back().size() - 2 - strlen(g.value));
+    }
+    double cascade = 1e9, table = 1e9;
+    for (int run = 0; run < RUNS; run++) {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      for (int k = 0; k < ROUNDS; k++) {
+        num_abo = (f.separator == '\t') ? 0 : f.contract;
+        for (std::string &l : lines) {
+          if (f.separator == '\t') traitbuf_std(&l[0], l.size());
+          else traitbuf_cpt(&l[0], l.size());
+        }
+      }
+      cascade = min(cascade, nsSince(start) / ROUNDS / lines.size());
+      start = std::chrono::steady_clock::now();
+      for (int k = 0; k < ROUNDS; k++) {
+        for (size_t j = 0; j < lines.size(); j++) {
+          const char *l = lines[j].data();
+          traitgroupe(l + 1, labelLen[j], l + valueAt[j], lines[j].size() - 2 - valueAt[j]);
+        }
+      }
+      table = min(table, nsSince(start) / ROUNDS / lines.size());
+    }
+    printf("  %-8s %-6s %2zu lines: cascade %5.1f ns, table %5.1f ns\n", (f.separator == '\t') ? "standard" : "historic",
+           f.name, lines.size(), cascade, table);
+  }
+  return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * Host build of the sketch modules
+ * The part of the Teensy core they use, time is simulated: millis() only
+ * moves when a test, delay() or yield() moves it
+ */
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+#include <deque>
+#include <string>
+#include <type_traits>
+
+#define PROGMEM
+#define DMAMEM
+#define PSTR(s) (s)
+class __FlashStringHelper;
+#define F(s) ((const __FlashStringHelper *)(s))
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLDOWN 3
+#define FALLING 2
+#define DEC 10
+#define HEX 16
+
+#define SERIAL_8N1 0x00
+#define SERIAL_7E1 0x01
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+// Simulated time, ms
+extern uint32_t hostMillis;
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+int digitalRead(int pin);
+void attachInterrupt(int pin, void (*isr)(), int mode);
+void detachInterrupt(int pin);
+void noInterrupts();
+void interrupts();
+
+template<class A, class B> typename std::common_type<A, B>::type min(A a, B b) { return (a < b) ? a : b; }
+template<class A, class B> typename std::common_type<A, B>::type max(A a, B b) { return (a > b) ? a : b; }
+
+// What the sketch uses of String
+class String : public std::string {
+public:
+  String(const char *s = "") : std::string(s) {}
+};
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buf, size_t len) {
+    size_t n = 0;
+    while (len--) n += write(*buf++);
+    return n;
+  }
+  size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+  size_t print(const char *s) { return write(s); }
+  size_t print(const __FlashStringHelper *s) { return write((const char *)s); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(long v, int base = DEC) { return printf((base == HEX) ? "%lx" : "%ld", v); }
+  size_t print(unsigned long v, int base = DEC) { return printf((base == HEX) ? "%lx" : "%lu", v); }
+  size_t print(int v, int base = DEC) { return print((long)v, base); }
+  size_t print(unsigned int v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(unsigned char v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(double v, int digits = 2) { return printf("%.*f", digits, v); }
+  size_t println() { return write("\r\n"); }
+  template<class T> size_t println(T v) { size_t n = print(v); return n + println(); }
+  template<class T> size_t println(T v, int base) { size_t n = print(v, base); return n + println(); }
+  int printf(const char *format, ...) {
+    char text[512];
+    va_list ap;
+    va_start(ap, format);
+    int n = vsnprintf(text, sizeof(text), format, ap);
+    va_end(ap);
+    write(text);
+    return n;
+  }
+  virtual int availableForWrite() { return 0; }
+  virtual void flush() {}
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  size_t readBytes(char *buf, size_t len) {
+    size_t n = 0;
+    int c;
+    while ((n < len) && ((c = read()) >= 0)) buf[n++] = c;
+    return n;
+  }
+};
+
+// UART: what the far end sends is queued by receive(), a full receive
+// buffer drops bytes as the serial driver does (63 bytes + the memory
+// given by addMemoryForRead()); what the sketch writes goes to stdout
+// when HOST_VERBOSE is set
+class HardwareSerial : public Stream {
+public:
+  uint32_t baud = 0;
+  int begins = 0;
+  size_t capacity = 63;
+  uint32_t dropped = 0;
+  std::deque<uint8_t> rx;
+
+  virtual void begin(uint32_t rate, uint16_t format = SERIAL_8N1) {
+    baud = rate;
+    begins++;
+    rx.clear();
+  }
+  virtual void end() {}
+  void addMemoryForRead(void *buf, size_t len) { capacity = 63 + len; }
+  void addMemoryForWrite(void *buf, size_t len) {}
+  void receive(uint8_t c) {
+    if (rx.size() >= capacity) dropped++;
+    else rx.push_back(c);
+  }
+  void receive(const char *s, size_t len) {
+    while (len--) receive((uint8_t)*s++);
+  }
+  int available() override { return rx.size(); }
+  int read() override {
+    if (rx.empty()) return -1;
+    int c = rx.front();
+    rx.pop_front();
+    return c;
+  }
+  int peek() override { return rx.empty() ? -1 : rx.front(); }
+  size_t write(uint8_t c) override {
+    if (getenv("HOST_VERBOSE")) putchar(c);
+    return 1;
+  }
+  using Print::write;
+};
+
+extern HardwareSerial Serial, Serial1, Serial4;
+
+#endif
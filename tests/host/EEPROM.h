@@ -0,0 +1,28 @@
+/*
+ * Host build: EEPROM of the Teensy 4.1 (4284 bytes), blank at start
+ */
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+#include "Arduino.h"
+
+class EEPROMClass {
+public:
+  uint8_t memory[4284];
+  uint32_t writes = 0;  // put() calls
+
+  EEPROMClass() { memset(memory, 0xFF, sizeof(memory)); }
+  template<class T> T &get(int address, T &t) {
+    memcpy(&t, &memory[address], sizeof(T));
+    return t;
+  }
+  template<class T> const T &put(int address, const T &t) {
+    memcpy(&memory[address], &t, sizeof(T));
+    writes++;
+    return t;
+  }
+};
+
+inline EEPROMClass EEPROM;
+
+#endif
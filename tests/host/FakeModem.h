@@ -0,0 +1,74 @@
+/*
+ * Host build: scripted SIM7600 on a Stream
+ * Each command line the driver writes (ended by LF, or Ctrl-Z for an SMS
+ * body) is logged and, when it contains the expected text of the next
+ * step, answered with its reply after its delay in ms
+ */
+#ifndef FAKE_MODEM_H
+#define FAKE_MODEM_H
+
+#include "Arduino.h"
+#include <deque>
+#include <string>
+
+class FakeModem : public Stream {
+public:
+  struct Step {
+    std::string expect;  // Part of the command, empty matches any
+    std::string reply;
+    uint32_t delay;
+  };
+  std::deque<Step> script;
+  std::string log;       // Commands received, each followed by '|'
+  int commands = 0;
+
+  void expect(const char *command, const char *reply, uint32_t delay = 5) {
+    script.push_back({command, reply, delay});
+  }
+  // Lines the modem sends on its own, e.g. URCs
+  void inject(const char *text) {
+    tx += text;
+  }
+  // Replies of begin(): AT, ATE0 twice, AT+CVHU, ATI, AT+CPMS
+  void expectBegin() {
+    expect("AT", "\r\nOK\r\n");
+    expect("ATE0", "\r\nOK\r\n");
+    expect("ATE0", "\r\nOK\r\n");
+    expect("CVHU", "\r\nOK\r\n");
+    expect("ATI", "\r\nManufacturer: SIMCOM\r\nOK\r\n");
+    expect("CPMS", "\r\n+CPMS: 0,30\r\n\r\nOK\r\n");
+  }
+
+  size_t write(uint8_t c) override {
+    rx += (char)c;
+    if ((c != '\n') && (c != 0x1A)) return 1;
+    std::string line = rx;
+    rx.clear();
+    while (!line.empty() && ((line.back() == '\n') || (line.back() == '\r'))) line.pop_back();
+    if (line.empty() && (c == '\n')) return 1;
+    log += line + "|";
+    commands++;
+    if (!script.empty() && (script.front().expect.empty() || (line.find(script.front().expect) != std::string::npos))) {
+      tx += script.front().reply;
+      readyAt = millis() + script.front().delay;
+      script.pop_front();
+    }
+    return 1;
+  }
+  using Print::write;
+  int available() override { return (millis() >= readyAt) ? (int)tx.size() : 0; }
+  int read() override {
+    if (!available()) return -1;
+    int c = (uint8_t)tx[0];
+    tx.erase(0, 1);
+    return c;
+  }
+  int peek() override { return available() ? (uint8_t)tx[0] : -1; }
+
+private:
+  std::string rx;        // Command being written
+  std::string tx;        // Bytes for the driver
+  uint32_t readyAt = 0;  // millis() of the next reply
+};
+
+#endif
@@ -0,0 +1,176 @@
+/*
+ * Host build: ILI9341_t3n drawing and panel model, see ILI9341_t3n.h
+ */
+#include "ILI9341_t3n.h"
+
+SPIClass SPI;
+ILI9341_t3n *ILI9341_t3n::lcd = 0;
+
+// 5 columns of 7 rows per character, made up: the tests only compare the
+// sketch with this model, both draw with it
+extern "C" const unsigned char glcdfont[256 * 5] = {
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x17, 0x5E, 0x26, 0x6D, 0x35, 0x1B, 0x62, 0x2A, 0x71, 0x39, 0x1F, 0x66, 0x2E, 0x75, 0x3D,
+  0x23, 0x6A, 0x32, 0x79, 0x41, 0x27, 0x6E, 0x36, 0x7D, 0x45, 0x2B, 0x72, 0x3A, 0x02, 0x49, 0x2F, 0x76, 0x3E, 0x06, 0x4D,
+  0x33, 0x7A, 0x42, 0x0A, 0x51, 0x37, 0x7E, 0x46, 0x0E, 0x55, 0x3B, 0x03, 0x4A, 0x12, 0x59, 0x3F, 0x07, 0x4E, 0x16, 0x5D,
+  0x43, 0x0B, 0x52, 0x1A, 0x61, 0x47, 0x0F, 0x56, 0x1E, 0x65, 0x4B, 0x13, 0x5A, 0x22, 0x69, 0x4F, 0x17, 0x5E, 0x26, 0x6D,
+  0x53, 0x1B, 0x62, 0x2A, 0x71, 0x57, 0x1F, 0x66, 0x2E, 0x75, 0x5B, 0x23, 0x6A, 0x32, 0x79, 0x5F, 0x27, 0x6E, 0x36, 0x7D,
+  0x63, 0x2B, 0x72, 0x3A, 0x02, 0x67, 0x2F, 0x76, 0x3E, 0x06, 0x6B, 0x33, 0x7A, 0x42, 0x0A, 0x6F, 0x37, 0x7E, 0x46, 0x0E,
+  0x73, 0x3B, 0x03, 0x4A, 0x12, 0x77, 0x3F, 0x07, 0x4E, 0x16, 0x7B, 0x43, 0x0B, 0x52, 0x1A, 0x7F, 0x47, 0x0F, 0x56, 0x1E,
+  0x04, 0x4B, 0x13, 0x5A, 0x22, 0x08, 0x4F, 0x17, 0x5E, 0x26, 0x0C, 0x53, 0x1B, 0x62, 0x2A, 0x10, 0x57, 0x1F, 0x66, 0x2E,
+  0x14, 0x5B, 0x23, 0x6A, 0x32, 0x18, 0x5F, 0x27, 0x6E, 0x36, 0x1C, 0x63, 0x2B, 0x72, 0x3A, 0x20, 0x67, 0x2F, 0x76, 0x3E,
+  0x24, 0x6B, 0x33, 0x7A, 0x42, 0x28, 0x6F, 0x37, 0x7E, 0x46, 0x2C, 0x73, 0x3B, 0x03, 0x4A, 0x30, 0x77, 0x3F, 0x07, 0x4E,
+  0x34, 0x7B, 0x43, 0x0B, 0x52, 0x38, 0x7F, 0x47, 0x0F, 0x56, 0x3C, 0x04, 0x4B, 0x13, 0x5A, 0x40, 0x08, 0x4F, 0x17, 0x5E,
+  0x44, 0x0C, 0x53, 0x1B, 0x62, 0x48, 0x10, 0x57, 0x1F, 0x66, 0x4C, 0x14, 0x5B, 0x23, 0x6A, 0x50, 0x18, 0x5F, 0x27, 0x6E,
+  0x54, 0x1C, 0x63, 0x2B, 0x72, 0x58, 0x20, 0x67, 0x2F, 0x76, 0x5C, 0x24, 0x6B, 0x33, 0x7A, 0x60, 0x28, 0x6F, 0x37, 0x7E,
+  0x64, 0x2C, 0x73, 0x3B, 0x03, 0x68, 0x30, 0x77, 0x3F, 0x07, 0x6C, 0x34, 0x7B, 0x43, 0x0B, 0x70, 0x38, 0x7F, 0x47, 0x0F,
+  0x74, 0x3C, 0x04, 0x4B, 0x13, 0x78, 0x40, 0x08, 0x4F, 0x17, 0x7C, 0x44, 0x0C, 0x53, 0x1B, 0x01, 0x48, 0x10, 0x57, 0x1F,
+  0x05, 0x4C, 0x14, 0x5B, 0x23, 0x09, 0x50, 0x18, 0x5F, 0x27, 0x0D, 0x54, 0x1C, 0x63, 0x2B, 0x11, 0x58, 0x20, 0x67, 0x2F,
+  0x15, 0x5C, 0x24, 0x6B, 0x33, 0x19, 0x60, 0x28, 0x6F, 0x37, 0x1D, 0x64, 0x2C, 0x73, 0x3B, 0x21, 0x68, 0x30, 0x77, 0x3F,
+  0x25, 0x6C, 0x34, 0x7B, 0x43, 0x29, 0x70, 0x38, 0x7F, 0x47, 0x2D, 0x74, 0x3C, 0x04, 0x4B, 0x31, 0x78, 0x40, 0x08, 0x4F,
+  0x35, 0x7C, 0x44, 0x0C, 0x53, 0x39, 0x01, 0x48, 0x10, 0x57, 0x3D, 0x05, 0x4C, 0x14, 0x5B, 0x41, 0x09, 0x50, 0x18, 0x5F,
+  0x45, 0x0D, 0x54, 0x1C, 0x63, 0x49, 0x11, 0x58, 0x20, 0x67, 0x4D, 0x15, 0x5C, 0x24, 0x6B, 0x51, 0x19, 0x60, 0x28, 0x6F,
+  0x55, 0x1D, 0x64, 0x2C, 0x73, 0x59, 0x21, 0x68, 0x30, 0x77, 0x5D, 0x25, 0x6C, 0x34, 0x7B, 0x61, 0x29, 0x70, 0x38, 0x7F,
+  0x65, 0x2D, 0x74, 0x3C, 0x04, 0x69, 0x31, 0x78, 0x40, 0x08, 0x6D, 0x35, 0x7C, 0x44, 0x0C, 0x71, 0x39, 0x01, 0x48, 0x10,
+  0x75, 0x3D, 0x05, 0x4C, 0x14, 0x79, 0x41, 0x09, 0x50, 0x18, 0x7D, 0x45, 0x0D, 0x54, 0x1C, 0x02, 0x49, 0x11, 0x58, 0x20,
+  0x06, 0x4D, 0x15, 0x5C, 0x24, 0x0A, 0x51, 0x19, 0x60, 0x28, 0x0E, 0x55, 0x1D, 0x64, 0x2C, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+ILI9341_t3n::ILI9341_t3n(uint8_t cs, uint8_t dc, uint8_t rst) {
+  memset(panel, 0, sizeof(panel));
+  if (lcd == 0) lcd = this;
+}
+
+uint8_t ILI9341_t3n::useFrameBuffer(bool use) {
+  if (use && (frameBuffer == 0)) frameBuffer = (uint16_t *)calloc(ILI9341_TFTWIDTH * ILI9341_TFTHEIGHT, 2);
+  useFB = use;
+  return 1;
+}
+
+void ILI9341_t3n::setClipRect(int16_t x, int16_t y, int16_t w, int16_t h) {
+  clipX0 = max(x, (int16_t)0);
+  clipY0 = max(y, (int16_t)0);
+  clipX1 = min((int16_t)(x + w), width());
+  clipY1 = min((int16_t)(y + h), height());
+}
+
+void ILI9341_t3n::drawPixel(int16_t x, int16_t y, uint16_t color) {
+  if ((x < clipX0) || (y < clipY0) || (x >= clipX1) || (y >= clipY1)) return;
+  if (useFB) {
+    frameBuffer[y * ILI9341_TFTWIDTH + x] = color;
+  }
+  else {
+    // Straight to the LCD, a window of one pixel
+    panel[y * ILI9341_TFTWIDTH + x] = color;
+    pixelBytes += 2;
+  }
+}
+
+void ILI9341_t3n::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+  for (int16_t j = y; j < y + h; j++) {
+    for (int16_t i = x; i < x + w; i++) drawPixel(i, j, color);
+  }
+}
+
+void ILI9341_t3n::drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) {
+  int16_t dx = abs(x1 - x0), sx = (x0 < x1) ? 1 : -1;
+  int16_t dy = -abs(y1 - y0), sy = (y0 < y1) ? 1 : -1;
+  int16_t error = dx + dy;
+  for (;;) {
+    drawPixel(x0, y0, color);
+    if ((x0 == x1) && (y0 == y1)) break;
+    if (2 * error >= dy) {
+      error += dy;
+      x0 += sx;
+    }
+    if (2 * error <= dx) {
+      error += dx;
+      y0 += sy;
+    }
+  }
+}
+
+// 6x8 cell, the sixth column blank; same colours: background left as is
+void ILI9341_t3n::drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg, uint8_t size) {
+  for (int8_t i = 0; i < 6; i++) {
+    uint8_t line = (i < 5) ? glcdfont[c * 5 + i] : 0;
+    for (int8_t j = 0; j < 8; j++, line >>= 1) {
+      if (line & 1) fillRect(x + i * size, y + j * size, size, size, color);
+      else if (bg != color) fillRect(x + i * size, y + j * size, size, size, bg);
+    }
+  }
+}
+
+size_t ILI9341_t3n::write(uint8_t c) {
+  if (c == '\n') {
+    cursorY += textSize * 8;
+    cursorX = 0;
+  }
+  else if (c != '\r') {
+    drawChar(cursorX, cursorY, c, textColor, textBackground, textSize);
+    cursorX += textSize * 6;
+    if (cursorX > width() - textSize * 6) {
+      cursorY += textSize * 8;
+      cursorX = 0;
+    }
+  }
+  return 1;
+}
+
+uint16_t ILI9341_t3n::screenPixel(int16_t x, int16_t y) {
+  int16_t row = y;
+  // Rows of the scrolling area start at scrollStart
+  if ((y >= scrollTop) && (y < scrollTop + scrollHeight)) {
+    row = scrollTop + ((y - scrollTop + scrollStart - scrollTop) % scrollHeight + scrollHeight) % scrollHeight;
+  }
+  return panel[row * ILI9341_TFTWIDTH + x];
+}
+
+void ILI9341_t3n::setAddr(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1) {
+  windowX0 = x0;
+  windowY0 = y0;
+  windowX1 = x1;
+  windowY1 = y1;
+}
+
+void ILI9341_t3n::command(uint8_t c) {
+  lastCommand = c;
+  dataCount = 0;
+  if (c == ILI9341_RAMWR) {
+    // The bytes that follow fill the window, row by row
+    writeX = windowX0;
+    writeY = windowY0;
+    windows++;
+    _pspi->device = this;
+  }
+}
+
+void ILI9341_t3n::data16(uint16_t d) {
+  if (lastCommand == ILI9341_VSCRDEF) {
+    if (dataCount == 0) scrollTop = d;
+    else if (dataCount == 1) scrollHeight = d;
+  }
+  else if (lastCommand == ILI9341_VSCRSADD) {
+    scrollStart = d;
+  }
+  dataCount++;
+}
+
+// RGB565 pixels, high byte first
+void ILI9341_t3n::receiveBytes(const uint8_t *buf, size_t count) {
+  for (size_t i = 0; i + 1 < count; i += 2) {
+    if (writeY <= windowY1) panel[writeY * ILI9341_TFTWIDTH + writeX] = (buf[i] << 8) | buf[i + 1];
+    pixelBytes += 2;
+    if (++writeX > windowX1) {
+      writeX = windowX0;
+      writeY++;
+    }
+  }
+}
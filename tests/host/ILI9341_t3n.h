@@ -0,0 +1,111 @@
+/*
+ * Host build: ILI9341_t3n and the panel behind it
+ * Drawing goes to the framebuffer when it is used, else straight to the
+ * panel. The panel keeps its memory, the address window of RAMWR and the
+ * vertical scrolling registers, and counts the pixel bytes it receives.
+ * glcdfont is a made-up 5x7 font, see ILI9341_t3n.cpp
+ */
+#ifndef HOST_ILI9341_T3N_H
+#define HOST_ILI9341_T3N_H
+
+#include "Arduino.h"
+#include "SPI.h"
+
+#define ILI9341_TFTWIDTH 240
+#define ILI9341_TFTHEIGHT 320
+
+#define ILI9341_RAMWR 0x2C
+#define ILI9341_VSCRDEF 0x33
+#define ILI9341_VSCRSADD 0x37
+
+#define ILI9341_BLACK 0x0000
+#define ILI9341_BLUE 0x001F
+#define ILI9341_RED 0xF800
+#define ILI9341_GREEN 0x07E0
+#define ILI9341_CYAN 0x07FF
+#define ILI9341_MAGENTA 0xF81F
+#define ILI9341_YELLOW 0xFFE0
+#define ILI9341_WHITE 0xFFFF
+#define ILI9341_ORANGE 0xFD20
+#define ILI9341_DARKGREY 0x7BEF
+#define ILI9341_LIGHTSKYBLUE 0x867F
+#define ILI9341_AZURE 0x1BF5
+#define ILI9341_VIOLET 0x915C
+
+extern "C" const unsigned char glcdfont[];
+
+class ILI9341_t3n : public Print, public SPIDevice {
+public:
+  // Panel
+  uint16_t panel[ILI9341_TFTWIDTH * ILI9341_TFTHEIGHT];
+  uint16_t scrollTop = 0;
+  uint16_t scrollHeight = ILI9341_TFTHEIGHT;
+  uint16_t scrollStart = 0;
+  uint64_t pixelBytes = 0;  // Received in RAMWR windows
+  uint32_t windows = 0;     // RAMWR commands
+
+  // The first one built, the LCD of the sketch
+  static ILI9341_t3n *lcd;
+
+  ILI9341_t3n(uint8_t cs, uint8_t dc, uint8_t rst = 255);
+  void begin(uint32_t clock = 30000000) {}
+  uint8_t useFrameBuffer(bool use);
+  uint16_t *getFrameBuffer() { return frameBuffer; }
+  int16_t width() { return ILI9341_TFTWIDTH; }
+  int16_t height() { return ILI9341_TFTHEIGHT; }
+
+  void fillScreen(uint16_t color) { fillRect(0, 0, width(), height(), color); }
+  void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+  void drawPixel(int16_t x, int16_t y, uint16_t color);
+  void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) { fillRect(x, y, w, 1, color); }
+  void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) { fillRect(x, y, 1, h, color); }
+  void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color);
+  void drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg, uint8_t size);
+  void setCursor(int16_t x, int16_t y) { cursorX = x; cursorY = y; }
+  int16_t getCursorX() { return cursorX; }
+  int16_t getCursorY() { return cursorY; }
+  // One colour: transparent background
+  void setTextColor(uint16_t color) { textColor = textBackground = color; }
+  void setTextColor(uint16_t color, uint16_t background) { textColor = color; textBackground = background; }
+  void setTextSize(uint8_t size) { textSize = size; }
+  void setClipRect(int16_t x, int16_t y, int16_t w, int16_t h);
+  void setClipRect() { setClipRect(0, 0, width(), height()); }
+  void setScroll(uint16_t offset) { scrollStart = offset; }
+  size_t write(uint8_t c) override;
+  using Print::write;
+
+  // What the panel shows at x, y with its scrolling
+  uint16_t screenPixel(int16_t x, int16_t y);
+  void receiveBytes(const uint8_t *buf, size_t count) override;
+
+protected:
+  SPIClass *_pspi = &SPI;
+  uint32_t _SPI_CLOCK = 30000000;
+  uint32_t _tcr_dc_not_assert = 0;
+
+  void beginSPITransaction(uint32_t clock) {}
+  void endSPITransaction() {}
+  void maybeUpdateTCR(uint32_t tcr) {}
+  void setAddr(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1);
+  void writecommand_cont(uint8_t c) { command(c); }
+  void writecommand_last(uint8_t c) { command(c); }
+  void writedata16_cont(uint16_t d) { data16(d); }
+  void writedata16_last(uint16_t d) { data16(d); }
+
+private:
+  uint16_t *frameBuffer = 0;
+  bool useFB = false;
+  int16_t clipX0 = 0, clipY0 = 0, clipX1 = ILI9341_TFTWIDTH, clipY1 = ILI9341_TFTHEIGHT;
+  int16_t cursorX = 0, cursorY = 0;
+  uint16_t textColor = 0xFFFF, textBackground = 0xFFFF;
+  uint8_t textSize = 1;
+  uint8_t lastCommand = 0;
+  uint8_t dataCount = 0;
+  int16_t windowX0 = 0, windowY0 = 0, windowX1 = 0, windowY1 = 0;
+  int16_t writeX = 0, writeY = 0;
+
+  void command(uint8_t c);
+  void data16(uint16_t d);
+};
+
+#endif
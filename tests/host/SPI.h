@@ -0,0 +1,47 @@
+/*
+ * Host build: SPI with the asynchronous transfer of the Teensy 4 library
+ * A transfer goes to the device that asked for the bus, then its
+ * EventResponder fires as the DMA interrupt would
+ */
+#ifndef HOST_SPI_H
+#define HOST_SPI_H
+
+#include "Arduino.h"
+
+class EventResponder;
+typedef EventResponder &EventResponderRef;
+
+class EventResponder {
+public:
+  void attachImmediate(void (*function)(EventResponderRef event)) { handler = function; }
+  void triggerEvent() {
+    if (handler) handler(*this);
+  }
+private:
+  void (*handler)(EventResponderRef event) = 0;
+};
+
+// What is on the other end of the bus
+class SPIDevice {
+public:
+  virtual void receiveBytes(const uint8_t *buf, size_t count) = 0;
+};
+
+class SPIClass {
+public:
+  SPIDevice *device = 0;
+  uint32_t transfers = 0;
+
+  bool transfer(const void *buf, void *retbuf, size_t count, EventResponderRef event) {
+    transfers++;
+    if (device) device->receiveBytes((const uint8_t *)buf, count);
+    event.triggerEvent();
+    return true;
+  }
+};
+
+extern SPIClass SPI;
+
+#define LPSPI_TCR_FRAMESZ(n) ((uint32_t)(n))
+
+#endif
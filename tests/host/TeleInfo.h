@@ -0,0 +1,5 @@
+/*
+ * Host build: teleInfo.cpp includes its header as <TeleInfo.h>, the file
+ * system of the host tells the case apart
+ */
+#include "teleInfo.h"
@@ -0,0 +1,21 @@
+/*
+ * Host build: TimeLib on the simulated clock, see hostCore.cpp
+ */
+#ifndef HOST_TIMELIB_H
+#define HOST_TIMELIB_H
+
+#include <time.h>
+
+#define SECS_PER_HOUR 3600UL
+#define SECS_PER_DAY 86400UL
+
+time_t now();
+void setTime(time_t t);
+int hour();
+int minute();
+int second();
+int day();
+int month();
+int year();
+
+#endif
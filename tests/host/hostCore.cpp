@@ -0,0 +1,42 @@
+/*
+ * Host build: simulated clock and serial ports of Arduino.h and TimeLib.h
+ */
+#include "Arduino.h"
+#include "TimeLib.h"
+
+uint32_t hostMillis = 0;
+static time_t hostEpoch = 1729024682;  // 2024-10-15 20:38:02 UTC at millis() 0
+
+HardwareSerial Serial, Serial1, Serial4;
+
+uint32_t millis() { return hostMillis; }
+uint32_t micros() { return hostMillis * 1000; }
+void delay(uint32_t ms) { hostMillis += ms; }
+void delayMicroseconds(uint32_t us) {}
+// A busy wait must see the time move
+void yield() { hostMillis++; }
+
+void pinMode(int pin, int mode) {}
+void digitalWrite(int pin, int value) {}
+int digitalRead(int pin) { return LOW; }
+void attachInterrupt(int pin, void (*isr)(), int mode) {}
+void detachInterrupt(int pin) {}
+void noInterrupts() {}
+void interrupts() {}
+
+time_t now() { return hostEpoch + hostMillis / 1000; }
+void setTime(time_t t) { hostEpoch = t - hostMillis / 1000; }
+
+static struct tm hostTime() {
+  time_t t = now();
+  struct tm tm;
+  gmtime_r(&t, &tm);
+  return tm;
+}
+
+int hour() { return hostTime().tm_hour; }
+int minute() { return hostTime().tm_min; }
+int second() { return hostTime().tm_sec; }
+int day() { return hostTime().tm_mday; }
+int month() { return hostTime().tm_mon + 1; }
+int year() { return hostTime().tm_year + 1900; }
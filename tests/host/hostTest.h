@@ -0,0 +1,26 @@
+/*
+ * Host build: checks of the test programs
+ * A failed CHECK prints where and carries on, the program then returns 1
+ */
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+
+static int hostFailures = 0;
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      hostFailures++; \
+    } \
+  } while (0)
+
+// Exit status of a test program
+static inline int testResult(const char *name) {
+  printf("%s: %s\n", name, (hostFailures == 0) ? "ok" : "FAILED");
+  return (hostFailures == 0) ? 0 : 1;
+}
+
+#endif
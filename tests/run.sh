@@ -0,0 +1,50 @@
+#!/bin/sh
+# Host tests of the sketch modules, the Teensy parts they use are in tests/host
+# Usage: tests/run.sh          build and run the tests
+#        tests/run.sh bench    the benchmarks too
+# CXX and BUILD_DIR (default tests/build) can be set in the environment
+
+cd "$(dirname "$0")/.." || exit 1
+CXX=${CXX:-g++}
+BUILD_DIR=${BUILD_DIR:-tests/build}
+FLAGS="-std=gnu++17 -O2 -Itests/host -I."
+failed=0
+
+mkdir -p "$BUILD_DIR"
+
+# build <program> <flags and sources...>
+build() {
+  program=$1
+  shift
+  if ! $CXX $FLAGS -o "$BUILD_DIR/$program" "$@" tests/host/hostCore.cpp; then
+    echo "$program: build FAILED"
+    failed=1
+    return 1
+  fi
+}
+
+# check <program> <flags and sources...>, the program returns 0 when it passes
+check() {
+  build "$@" && { "$BUILD_DIR/$1" || failed=1; }
+}
+
+check testSim7600Engine tests/testSim7600Engine.cpp SIM7600.cpp
+check testSim7600Modes tests/testSim7600Modes.cpp SIM7600.cpp
+check testSim7600Tokenizer tests/testSim7600Tokenizer.cpp SIM7600.cpp
+check testTeleInfoReplay tests/testTeleInfoReplay.cpp teleInfo.cpp
+
+DISPLAY_SOURCES="display.cpp tests/host/ILI9341_t3n.cpp"
+check testDisplayFrames tests/testDisplayFrames.cpp $DISPLAY_SOURCES
+# The 16 bpp screen is the reference of the palette depths
+for bpp in 16 8 4; do
+  build testDisplayDepth$bpp -DDISPLAY_BPP=$bpp tests/testDisplayDepth.cpp $DISPLAY_SOURCES &&
+    { "$BUILD_DIR/testDisplayDepth$bpp" "$BUILD_DIR/displayDepth.screen" || failed=1; }
+done
+
+if [ "$1" = "bench" ]; then
+  build benchDisplayBandwidth tests/benchDisplayBandwidth.cpp $DISPLAY_SOURCES && "$BUILD_DIR/benchDisplayBandwidth"
+  check benchGlyphs tests/benchGlyphs.cpp $DISPLAY_SOURCES
+  build benchTeleInfoDispatch tests/benchTeleInfoDispatch.cpp teleInfo.cpp && "$BUILD_DIR/benchTeleInfoDispatch"
+fi
+
+exit $failed
@@ -0,0 +1,108 @@
+/*
+ * Host test of the framebuffer depths, built with -DDISPLAY_BPP=16, 8 and 4
+ * The same screens are drawn with more than 16 colors. At 16 bpp the LCD
+ * is saved to the file given as argument, at 8 bpp it must be the same,
+ * at 4 bpp the palette overflows and a pixel may only differ by the
+ * nearest color of the palette, as IndexedFB::colorIndex() picks it
+ */
+#include <set>
+#include "hostTest.h"
+#include "ILI9341_t3n.h"
+#include "display.h"
+
+#define PIXELS (ILI9341_TFTWIDTH * ILI9341_TFTHEIGHT)
+
+static uint16_t screen[PIXELS];
+static uint16_t reference[PIXELS];
+
+// Time for the governor, then the scroll that waits for the end of the frame
+static void settle() {
+  hostMillis += 200;
+  serviceDisplay();
+  hostMillis += 10;
+  serviceDisplay();
+}
+
+// Distance of colorIndex(): red and blue have 5 bits, green 6 bits
+static int32_t distance(uint16_t a, uint16_t b) {
+  int32_t r = 2 * (((a >> 11) & 0x1F) - ((b >> 11) & 0x1F));
+  int32_t g = ((a >> 5) & 0x3F) - ((b >> 5) & 0x3F);
+  int32_t blue = 2 * ((a & 0x1F) - (b & 0x1F));
+  return r * r + g * g + blue * blue;
+}
+
+int main(int argc, char **argv) {
+  ILI9341_t3n *lcd;
+  std::set<uint16_t> colors;
+  char text[40];
+  FILE *f;
+  int i, x, y;
+
+  if (argc != 2) {
+    printf("Usage: %s <reference screen>\n", argv[0]);
+    return 1;
+  }
+
+  // Dashboard, then console lines of 24 colors
+  initDisplay();
+  updateTime();
+  updateDate();
+  updateWater(1234);
+  updateProd(56789);
+  updateHP(-12);
+  updateHC(345);
+  updateAC(678);
+  updateECS(90);
+  updatePAC(44);
+  updateLux(120, 250);
+  settle();
+  for (i = 0; i < 24; i++) {
+    snprintf(text, sizeof(text), "message %d", i);
+    addMessage(text, (uint16_t)(0x0841 * i + 0x1234 * (i & 3)));
+    if (i % 5 == 0) addMessage2(text);
+    settle();
+  }
+
+  lcd = ILI9341_t3n::lcd;
+  for (y = 0; y < ILI9341_TFTHEIGHT; y++) {
+    for (x = 0; x < ILI9341_TFTWIDTH; x++) screen[y * ILI9341_TFTWIDTH + x] = lcd->screenPixel(x, y);
+  }
+  for (i = 0; i < PIXELS; i++) colors.insert(screen[i]);
+
+#if DISPLAY_BPP == 16
+  CHECK(colors.size() > 16);
+  f = fopen(argv[1], "wb");
+  CHECK((f != 0) && (fwrite(screen, sizeof(screen), 1, f) == 1));
+  if (f) fclose(f);
+#else
+  f = fopen(argv[1], "rb");
+  CHECK((f != 0) && (fread(reference, sizeof(reference), 1, f) == 1));
+  if (f) fclose(f);
+  int differences = 0;
+  for (i = 0; i < PIXELS; i++) {
+    if (screen[i] == reference[i]) continue;
+    differences++;
+#if DISPLAY_BPP == 4
+    // No color of the palette is nearer, the palette holds the colors on screen
+    int32_t nearest = 0x7FFFFFFF;
+    for (uint16_t color : colors) nearest = min(nearest, distance(reference[i], color));
+    if (distance(reference[i], screen[i]) != nearest) {
+      printf("%d, %d: %04x for %04x, a color at %d is on screen\n", i % ILI9341_TFTWIDTH, i / ILI9341_TFTWIDTH,
+             screen[i], reference[i], nearest);
+      CHECK(false);
+      break;
+    }
+#endif
+  }
+#if DISPLAY_BPP == 8
+  CHECK(differences == 0);
+#else
+  CHECK(colors.size() <= 16);
+  // The nearest color path ran
+  CHECK(differences > 0);
+#endif
+#endif
+
+  snprintf(text, sizeof(text), "testDisplayDepth%d", DISPLAY_BPP);
+  return testResult(text);
+}
@@ -0,0 +1,71 @@
+/*
+ * Host test of the display frames: once a frame is out, the panel holds
+ * exactly the framebuffer, whatever was drawn and scrolled before
+ */
+#include "hostTest.h"
+#include "ILI9341_t3n.h"
+#include "display.h"
+
+// Time for the governor, then the scroll that waits for the end of the frame
+static void settle() {
+  hostMillis += 200;
+  serviceDisplay();
+  hostMillis += 10;
+  serviceDisplay();
+}
+
+static int differences() {
+  ILI9341_t3n *lcd = ILI9341_t3n::lcd;
+  int n = 0;
+  for (int i = 0; i < ILI9341_TFTWIDTH * ILI9341_TFTHEIGHT; i++) {
+    if (lcd->panel[i] != lcd->getFrameBuffer()[i]) n++;
+  }
+  return n;
+}
+
+int main() {
+  char text[40];
+  initDisplay();
+  settle();
+  CHECK(differences() == 0);
+
+  for (int i = 0; i < 50; i++) {
+    updateTime();
+    updateDate();
+    updateWater(1234 + i);
+    updateProd(i * 12345);
+    updateHP(-i);
+    updateHC(i * 7);
+    updateAC(99999 - i);
+    updateECS(i);
+    updatePAC(44 + i);
+    updateLux(i * 10, 250);
+    snprintf(text, sizeof(text), "message %d", i);
+    addMessage(text, ILI9341_GREEN + i);
+    if (i % 3 == 0) addMessage2(text);
+    settle();
+    CHECK(differences() == 0);
+  }
+
+  // Only the changed cell goes out
+  ILI9341_t3n *lcd = ILI9341_t3n::lcd;
+  uint64_t before = lcd->pixelBytes;
+  updateWater(1);
+  settle();
+  CHECK(differences() == 0);
+  CHECK(lcd->pixelBytes - before < 72 * 16 * 2 * 2);
+
+  // Graph page and back
+  refreshGraph();
+  for (int i = 0; i < 30; i++) {
+    hostMillis += 60000;
+    addGraphSample(i, 2 * i, 3 * i, i % 5);
+  }
+  settle();
+  CHECK(differences() == 0);
+  refreshConsole();
+  settle();
+  CHECK(differences() == 0);
+
+  return testResult("testDisplayFrames");
+}
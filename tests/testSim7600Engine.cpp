@@ -0,0 +1,147 @@
+/*
+ * Host test of the SIM7600 command engine: queued transactions, replies,
+ * timeouts, URCs and the blocking wrappers, against a scripted modem
+ */
+#include <vector>
+#include "FakeModem.h"
+#include "hostTest.h"
+#include "SIM7600.h"
+
+static int lastResult;
+static std::string lastReply;
+static std::vector<std::string> urcs;
+
+static void onDone(uint8_t result, const char *reply, void *ctx) {
+  lastResult = result;
+  lastReply = reply;
+}
+
+static void onURC(const char *line, void *ctx) {
+  urcs.push_back(line);
+}
+
+// Poll until the queue is empty, 1 ms per poll as tModem does
+static uint32_t runQueue(SIM7600 &sim) {
+  uint32_t start = millis();
+  while (sim.busy()) {
+    sim.poll();
+    hostMillis++;
+  }
+  return millis() - start;
+}
+
+static void start(FakeModem &modem, SIM7600 &sim) {
+  modem.expectBegin();
+  CHECK(sim.begin(modem));
+  lastResult = -1;
+  lastReply.clear();
+  urcs.clear();
+}
+
+// An SMS goes out through the queue, the prompt and the final reply come in polls
+static void testAsyncSMS() {
+  FakeModem modem;
+  SIM7600 sim(21);
+  start(modem, sim);
+  modem.expect("AT+CMGF=1", "\r\nOK\r\n");
+  modem.expect("AT+CMGS=", "\r\n> ", 20);
+  modem.expect("hello", "\r\n+CMGS: 12\r\n\r\nOK\r\n", 3000);
+  CHECK(sim.sendSMSAsync((char *)"+33123", (char *)"hello", onDone));
+  CHECK(sim.busy());
+  runQueue(sim);
+  CHECK(lastResult == SIM7600_CMD_OK);
+  CHECK(lastReply == "+CMGS: 12");
+}
+
+// No reply: the transaction times out, the next one starts
+static void testTimeout() {
+  FakeModem modem;
+  SIM7600 sim(21);
+  start(modem, sim);
+  CHECK(sim.queueCommand("AT+CSQ", F("+CSQ"), 100, onDone));
+  uint32_t took = runQueue(sim);
+  CHECK(lastResult == SIM7600_CMD_TIMEOUT);
+  CHECK((took >= 100) && (took < 110));
+  modem.expect("AT+CSQ", "\r\n+CSQ: 17,99\r\n\r\nOK\r\n");
+  CHECK(sim.getRSSI() == 17);
+}
+
+// The expected line may come after OK, e.g. +CNTP
+static void testLineAfterOK() {
+  FakeModem modem;
+  SIM7600 sim(21);
+  start(modem, sim);
+  modem.expect("AT+CNTP", "\r\nOK\r\n\r\n+CNTP: 0\r\n");
+  CHECK(sim.queueCommand("AT+CNTP", F("+CNTP"), 1000, onDone));
+  runQueue(sim);
+  CHECK(lastResult == SIM7600_CMD_OK);
+  CHECK(lastReply == "+CNTP: 0");
+}
+
+// URCs within a reply are kept for the next poll(), not taken for the reply
+static void testURCDuringCommand() {
+  FakeModem modem;
+  SIM7600 sim(21);
+  start(modem, sim);
+  sim.onURC(F("+CMTI:"), onURC);
+  sim.onURC(F("+CREG:"), onURC);
+  modem.inject("\r\n+CMTI: \"SM\",1\r\n");
+  modem.expect("AT+CREG?", "\r\n+CMTI: \"SM\",2\r\n\r\n+CREG: 0,1\r\n\r\nOK\r\n");
+  CHECK(sim.getNetworkStatus() == 1);
+  CHECK(urcs.empty());
+  sim.poll();
+  CHECK(urcs.size() == 2);
+  modem.inject("\r\n+CREG: 5\r\n");
+  sim.poll();
+  CHECK((urcs.size() == 3) && (urcs[2] == "+CREG: 5"));
+}
+
+// While a queued SMS is in flight the blocking calls give up at once,
+// without sending anything
+static void testBlockingWhileBusy() {
+  FakeModem modem;
+  SIM7600 sim(21);
+  SIM7600SMS inbox[2];
+  start(modem, sim);
+  modem.expect("AT+CMGF=1", "\r\nOK\r\n");
+  modem.expect("AT+CMGS=", "\r\n> ", 20);
+  modem.expect("hello", "\r\n+CMGS: 12\r\n\r\nOK\r\n", 3000);
+  CHECK(sim.sendSMSAsync((char *)"+33123", (char *)"hello", onDone));
+  sim.poll();
+  int commands = modem.commands;
+  uint32_t start = millis();
+  CHECK(sim.listSMS(inbox, 2) == -1);
+  CHECK(!sim.deleteSMS(3));
+  CHECK(!sim.sendCheckReply(F("AT"), F("OK")));
+  CHECK(millis() - start < 5);
+  CHECK(modem.commands == commands);
+  runQueue(sim);
+  CHECK(lastResult == SIM7600_CMD_OK);
+}
+
+// A reply taken on its first line: its late OK is not taken by the next command
+static void testLateFinalResult() {
+  FakeModem modem;
+  SIM7600 sim(21);
+  float lat, lon, alt;
+  time_t date;
+  start(modem, sim);
+  modem.expect("AT+CSQ", "\r\n+CSQ: 17,99\r\n");
+  CHECK(sim.getRSSI() == 17);
+  modem.expect("AT+CGPSINFO", "\r\n+CGPSINFO: ,,,,,,,,\r\n");
+  CHECK(!sim.getGPS(&lat, &lon, &date, &alt));
+  hostMillis += 5;
+  modem.inject("\r\nOK\r\n");
+  modem.expect("AT+CREG?", "\r\n+CREG: 0,1\r\n\r\nOK\r\n");
+  CHECK(sim.getNetworkStatus() == 1);
+}
+
+int main() {
+  testAsyncSMS();
+  testTimeout();
+  testLineAfterOK();
+  testURCDuringCommand();
+  testBlockingWhileBusy();
+  testLateFinalResult();
+  return testResult("testSim7600Engine");
+}
@@ -0,0 +1,70 @@
+/*
+ * Host test of the SIM7600 mode cache: a configuration already applied is
+ * not sent again, until a failure, invalidateModes() or a modem restart
+ */
+#include "FakeModem.h"
+#include "hostTest.h"
+#include "SIM7600.h"
+
+// Count of the commands containing text in the log
+static int sent(FakeModem &modem, const char *text) {
+  int n = 0;
+  for (size_t at = modem.log.find(text); at != std::string::npos; at = modem.log.find(text, at + 1)) n++;
+  return n;
+}
+
+int main() {
+  FakeModem modem;
+  SIM7600 sim(21);
+  modem.expectBegin();
+  CHECK(sim.begin(modem));
+
+  // First use: sent
+  modem.expect("AT+CMGF=1", "\r\nOK\r\n");
+  modem.expect("AT+CSDH=1", "\r\nOK\r\n");
+  modem.expect("AT+CNMI=2,1", "\r\nOK\r\n");
+  CHECK(sim.setTextMode(true));
+  CHECK(sim.setSMSHeaders(true));
+  CHECK(sim.setSMSRouting(2, 1));
+  CHECK(modem.commands == 6 + 3);
+
+  // Same values: nothing sent
+  modem.log.clear();
+  CHECK(sim.setTextMode(true));
+  CHECK(sim.setSMSHeaders(true));
+  CHECK(sim.setSMSRouting(2, 1));
+  CHECK(modem.log.empty());
+
+  // A new value is sent, then cached
+  modem.expect("AT+CNMI=2,2", "\r\nOK\r\n");
+  CHECK(sim.setSMSRouting(2, 2));
+  CHECK(sim.setSMSRouting(2, 2));
+  CHECK(sent(modem, "AT+CNMI") == 1);
+
+  // A failure leaves the state unknown, the next call tries again
+  modem.log.clear();
+  modem.expect("AT+CMGF=0", "\r\nERROR\r\n");
+  modem.expect("AT+CMGF=1", "\r\nOK\r\n");
+  CHECK(!sim.setTextMode(false));
+  CHECK(sim.setTextMode(true));
+  CHECK(sent(modem, "AT+CMGF") == 2);
+
+  // invalidateModes() forgets everything
+  modem.log.clear();
+  sim.invalidateModes();
+  modem.expect("AT+CSDH=1", "\r\nOK\r\n");
+  CHECK(sim.setSMSHeaders(true));
+  CHECK(sent(modem, "AT+CSDH=1") == 1);
+
+  // So does "RDY" from a modem that restarted on its own
+  modem.log.clear();
+  modem.inject("\r\nRDY\r\n");
+  sim.poll();
+  CHECK(sim.wasReset());
+  CHECK(!sim.wasReset());
+  modem.expect("AT+CMGF=1", "\r\nOK\r\n");
+  CHECK(sim.setTextMode(true));
+  CHECK(sent(modem, "AT+CMGF=1") == 1);
+
+  return testResult("testSim7600Modes");
+}
@@ -0,0 +1,96 @@
+/*
+ * Host test of the SIM7600 reply tokenizer and of the parsers built on it
+ */
+#include "FakeModem.h"
+#include "hostTest.h"
+#include "SIM7600.h"
+
+// Reaches the protected parsers, with a reply put straight in the buffer
+class Parser : public SIM7600 {
+public:
+  Parser() : SIM7600(21) {}
+  void reply(const char *text) { strcpy(replybuffer, text); }
+  using SIM7600::tokenize;
+  using SIM7600::fieldToInt;
+  using SIM7600::fieldToFixed;
+  using SIM7600::fieldToMicroDegrees;
+  using SIM7600::parseReply;
+  using SIM7600::parseReplyQuoted;
+};
+
+static bool fieldIs(SIM7600Field field, const char *text) {
+  return (field.len == strlen(text)) && (strncmp(field.p, text, field.len) == 0);
+}
+
+static void testTokenize() {
+  Parser sim;
+  SIM7600Field fields[4];
+  int32_t v;
+
+  // Fields point into the reply, empty ones included
+  sim.reply("+X: 12.5,-3.25, 7,");
+  CHECK(sim.tokenize(F("+X:"), ',', fields, 4) == 4);
+  CHECK(fieldIs(fields[0], " 12.5"));
+  CHECK(fieldIs(fields[3], ""));
+  CHECK(Parser::fieldToFixed(fields[0], 3, &v) && (v == 12500));
+  CHECK(Parser::fieldToFixed(fields[1], 1, &v) && (v == -32));
+  CHECK(Parser::fieldToInt(fields[2], &v) && (v == 7));
+  CHECK(!Parser::fieldToInt(fields[3], &v));
+
+  // No more fields than asked for, the last one stops at its divider
+  sim.reply("+CSQ: 17,99,5,6,7");
+  CHECK(sim.tokenize(F("+CSQ: "), ',', fields, 2) == 2);
+  CHECK(fieldIs(fields[1], "99"));
+
+  // Prefix not in the reply
+  CHECK(sim.tokenize(F("+CREG: "), ',', fields, 4) == 0);
+
+  // ddmm.mmmmmm and its hemisphere, rounded to the micro-degree
+  sim.reply("+CGPSINFO: 4843.512345,S,00220.123456,E");
+  CHECK(sim.tokenize(F("+CGPSINFO: "), ',', fields, 4) == 4);
+  CHECK(Parser::fieldToMicroDegrees(fields[0], fields[1], &v) && (v == -48725206));
+  CHECK(Parser::fieldToMicroDegrees(fields[2], fields[3], &v) && (v == 2335391));
+}
+
+static void testParseReply() {
+  Parser sim;
+  uint16_t n;
+  char text[40];
+  float f;
+
+  sim.reply("+CSQ: 17,99");
+  CHECK(sim.parseReply(F("+CSQ: "), &n) && (n == 17));
+  CHECK(sim.parseReply(F("+CSQ: "), &n, ',', 1) && (n == 99));
+  CHECK(!sim.parseReply(F("+CSQ: "), &n, ',', 2));
+  sim.reply("+CMGR: \"REC READ\",\"+33612\",\"\",\"24/10\"");
+  CHECK(sim.parseReplyQuoted(F("+CMGR:"), text, 20, ',', 1) && (strcmp(text, "+33612") == 0));
+  sim.reply("+CLIP: \"+3361\",145");
+  CHECK(sim.parseReply(F("+CLIP: \""), text, '"') && (strcmp(text, "+3361") == 0));
+  sim.reply("+CBC: 0,95,4.1");
+  CHECK(sim.parseReply(F("+CBC: "), &f, ',', 2) && (fabs(f - 4.1) < 1e-6));
+}
+
+// getGPS() on a reply from the scripted modem
+static void testGPS() {
+  FakeModem modem;
+  Parser sim;
+  float lat, lon, alt;
+  time_t date;
+  modem.expectBegin();
+  CHECK(sim.begin(modem));
+  modem.expect("AT+CGPSINFO", "\r\n+CGPSINFO: 4843.512345,N,00220.123456,E,151024,203802.1,-12.0,0.0,0\r\n\r\nOK\r\n");
+  CHECK(sim.getGPS(&lat, &lon, &date, &alt));
+  CHECK(fabs(lat - 48.725205) < 1e-5);
+  CHECK(fabs(lon - 2.335391) < 1e-5);
+  CHECK(fabs(alt + 12.0) < 1e-6);
+  CHECK(date == 1729024682);
+  modem.expect("AT+CGPSINFO", "\r\n+CGPSINFO: ,,,,,,,,\r\n\r\nOK\r\n");
+  CHECK(!sim.getGPS(&lat, &lon, &date, &alt));
+}
+
+int main() {
+  testTokenize();
+  testParseReply();
+  testGPS();
+  return testResult("testSim7600Tokenizer");
+}
@@ -0,0 +1,214 @@
+/*
+ * Host replay of TeleInfo streams through Serial4 and read_teleinfo()
+ * A standard meter (Tempo, 9600 baud) then a historic one (HC contract,
+ * 1200 baud) send frames byte by byte at their rate. The sketch polls
+ * often (blocks of a few bytes), or seldom (bursts read TI_CHUNK at a
+ * time), and blocks of any size are also given to parse_teleinfo().
+ * Once the reader has locked on the rate, every frame must be published
+ * with the indexes it carried, and no line may be counted bad
+ */
+#include <string>
+#include "hostTest.h"
+#include "TeleInfo.h"
+
+extern byte num_abo;
+void parse_teleinfo(char *data, uint16_t len);
+
+static uint8_t rxBuffer[TI_RX_BUFFER];
+static uint32_t publications = 0;
+static uint64_t clockUs = 0;  // Finer than millis(), a byte lasts 1.04 ms at 9600 baud
+
+// Called for each published frame of a known contract
+void updateHC(int hc) { publications++; }
+void updateHP(int hp) {}
+
+// Line of a historic frame: LF label SP value SP checksum CR
+static std::string historic(const char *label, const char *value) {
+  std::string body = std::string(label) + " " + value;
+  int sum = 0;
+  for (char c : body) sum += c;
+  return "\n" + body + " " + (char)((sum & 0x3F) + 0x20) + "\r";
+}
+
+// Line of a standard frame: LF label HT [date HT] value HT checksum CR
+static std::string standard(const char *label, const char *value, const char *date = 0) {
+  std::string body = std::string(label) + "\t" + (date ? std::string(date) + "\t" : "") + value + "\t";
+  int sum = 0;
+  for (char c : body) sum += c;
+  return "\n" + body + (char)((sum & 0x3F) + 0x20) + "\r";
+}
+
+static std::string historicFrame(const unsigned long *index, unsigned long power) {
+  char hchc[12], hchp[12], papp[8];
+  snprintf(hchc, sizeof(hchc), "%09lu", index[0]);
+  snprintf(hchp, sizeof(hchp), "%09lu", index[1]);
+  snprintf(papp, sizeof(papp), "%05lu", power);
+  return "\x02" + historic("ADCO", "021728123456") + historic("OPTARIF", "HC..") + historic("ISOUSC", "45") +
+         historic("HCHC", hchc) + historic("HCHP", hchp) + historic("PTEC", "HP..") + historic("IINST", "008") +
+         historic("IMAX", "090") + historic("PAPP", papp) + historic("HHPHC", "A") + historic("MOTDETAT", "000000") + "\x03";
+}
+
+static std::string standardFrame(const unsigned long *index, unsigned long power, int tariff) {
+  char value[24], label[8];
+  unsigned long total = 0;
+  std::string s = "\x02";
+  s += standard("ADSC", "041876097467") + standard("VTIC", "02") + standard("DATE", "", "H240115143015");
+  s += standard("NGTF", "      TEMPO     ") + standard("LTARF", "    HP  BLEU    ");
+  for (int i = 0; i < TI_REGISTERS; i++) total += index[i];
+  snprintf(value, sizeof(value), "%09lu", total);
+  s += standard("EAST", value);
+  for (int i = 0; i < 10; i++) {
+    snprintf(label, sizeof(label), "EASF%02d", i + 1);
+    snprintf(value, sizeof(value), "%09lu", (i < TI_REGISTERS) ? index[i] : 0);
+    s += standard(label, value);
+  }
+  s += standard("IRMS1", "004") + standard("URMS1", "231") + standard("PREF", "09") + standard("PCOUP", "09");
+  snprintf(value, sizeof(value), "%05lu", power);
+  s += standard("SINSTS", value) + standard("SMAXSN", "04102", "H240115083012");
+  s += standard("UMOYN1", "229", "H240115143000") + standard("STGE", "003A0001");
+  s += standard("MSG1", "PAS DE          MESSAGE         ") + standard("PRM", "12345678901234");
+  snprintf(value, sizeof(value), "%02d", tariff);
+  s += standard("NTARF", value) + standard("RELAIS", "000");
+  s += standard("PJOURF+1", "00008001 NONUTILE NONUTILE NONUTILE NONUTILE NONUTILE NONUTILE NONUTILE NONUTILE NONUTILE NONUTILE");
+  return s + "\x03";
+}
+
+// Frames of a meter, with the values of the last one
+typedef struct {
+  std::string bytes;
+  int frames;
+  unsigned long index[TI_REGISTERS];
+  unsigned long power;
+  int tariff;
+}Meter;
+
+static Meter historicMeter(int frames) {
+  Meter s = {"", frames, {12345678, 23456789}, 0, 0};
+  for (int i = 0; i < frames; i++) {
+    s.index[i & 1] += 1 + i % 3;
+    s.power = 500 + 37 * i;
+    s.bytes += historicFrame(s.index, s.power);
+  }
+  return s;
+}
+
+static Meter standardMeter(int frames) {
+  Meter s = {"", frames, {1000000, 2000000, 300000, 400000, 50000, 60000}, 0, 0};
+  for (int i = 0; i < frames; i++) {
+    s.index[i % TI_REGISTERS] += 1 + i % 5;
+    s.power = 1000 + 91 * i;
+    s.tariff = 1 + i % 6;
+    s.bytes += standardFrame(s.index, s.power, s.tariff);
+  }
+  return s;
+}
+
+// The meter sends the stream at its rate, 10 bits a byte (7E1), the sketch
+// reads every pollMs; at any other rate the UART only gets garbage
+// Returns the number of frames published
+static uint32_t replay(const Meter &stream, uint32_t baud, uint32_t pollMs) {
+  uint32_t start = publications;
+  uint64_t byteUs = 10000000ULL / baud;
+  uint64_t next = clockUs;
+  size_t pos = 0;
+  while (pos < stream.bytes.size()) {
+    clockUs += pollMs * 1000;
+    while ((pos < stream.bytes.size()) && (next <= clockUs)) {
+      Serial4.receive((Serial4.baud == baud) ? stream.bytes[pos] : (char)(rand() & 0xFF));
+      pos++;
+      next += byteUs;
+    }
+    hostMillis = clockUs / 1000;
+    read_teleinfo();
+  }
+  return publications - start;
+}
+
+// The last frame of the stream is the published one
+static void checkLast(const Meter &stream, uint8_t mode, uint8_t contract) {
+  TeleInfoData ti;
+  CHECK(getTeleInfo(&ti));
+  CHECK(ti.mode == mode);
+  CHECK(ti.contract == contract);
+  CHECK(memcmp(ti.index, stream.index, sizeof(ti.index)) == 0);
+  CHECK(ti.apparentPower == stream.power);
+  CHECK(ti.tariffIndex == stream.tariff);
+}
+
+// No bad line nor lost byte between two snapshots of the stats
+static void checkClean(const TeleInfoStats &before, const TeleInfoStats &after) {
+  CHECK(after.checksumErrors == before.checksumErrors);
+  CHECK(after.overlongLines == before.overlongLines);
+  CHECK(after.overruns == before.overruns);
+  CHECK(after.lines > before.lines);
+}
+
+int main() {
+  TeleInfoStats locked, stats;
+  Meter stream;
+  uint32_t published;
+
+  srand(1);
+  Serial4.addMemoryForRead(rxBuffer, sizeof(rxBuffer));
+  init_teleinfo();
+
+  // Standard meter: garbage at 1200 baud until the reader tries 9600,
+  // the bad lines meanwhile are search errors
+  stream = standardMeter(20);
+  CHECK(replay(stream, 9600, 10) > 0);
+  CHECK(Serial4.baud == 9600);
+  CHECK(num_abo == 4);
+  getTeleInfoStats(&locked);
+  CHECK(locked.searchErrors > 0);
+  CHECK(locked.checksumErrors + locked.overlongLines == 0);
+
+  // Polled every 10 ms: a few bytes at a time
+  stream = standardMeter(60);
+  CHECK(replay(stream, 9600, 10) == stream.frames);
+  checkLast(stream, TI_STANDARD, 4);
+  getTeleInfoStats(&stats);
+  checkClean(locked, stats);
+  locked = stats;
+
+  // Polled every 1.5 s: 1440 bytes waiting, read TI_CHUNK at a time
+  stream = standardMeter(60);
+  CHECK(replay(stream, 9600, 1500) == stream.frames);
+  checkLast(stream, TI_STANDARD, 4);
+  getTeleInfoStats(&stats);
+  checkClean(locked, stats);
+  locked = stats;
+
+  // Blocks of any size, lines cut anywhere, straight to the parser
+  stream = standardMeter(60);
+  published = publications;
+  for (size_t pos = 0; pos < stream.bytes.size();) {
+    std::string block = stream.bytes.substr(pos, 1 + rand() % 300);
+    pos += block.size();
+    parse_teleinfo(&block[0], block.size());
+  }
+  CHECK(publications - published == (uint32_t)stream.frames);
+  checkLast(stream, TI_STANDARD, 4);
+  getTeleInfoStats(&stats);
+  checkClean(locked, stats);
+  CHECK(stats.frames - locked.frames == (uint32_t)stream.frames);
+
+  // A historic meter takes its place: the garbage at 9600 baud is counted
+  // as bad lines, the link was locked, until the reader goes back to 1200
+  stream = historicMeter(15);
+  CHECK(replay(stream, 1200, 10) > 0);
+  CHECK(Serial4.baud == 1200);
+  CHECK(num_abo == 2);
+  getTeleInfoStats(&locked);
+
+  // Polled every 10 ms, then every 1.5 s: 180 bytes waiting
+  stream = historicMeter(40);
+  CHECK(replay(stream, 1200, 10) == stream.frames);
+  checkLast(stream, TI_HISTORIC, 2);
+  stream = historicMeter(40);
+  CHECK(replay(stream, 1200, 1500) == stream.frames);
+  checkLast(stream, TI_HISTORIC, 2);
+  getTeleInfoStats(&stats);
+  checkClean(locked, stats);
+
+  return testResult("testTeleInfoReplay");
+}
@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+"""
+Screen snapshot of TSplc_v1, written as a PNG
+
+  snapshot.py screen.png --tcp 192.168.1.x[:2323]
+  snapshot.py screen.png --serial /dev/ttyACM0     (needs pyserial)
+  snapshot.py screen.png --file capture.bin        (- for stdin)
+
+The board answers the "snap" command with run-length-encoded RGB565 rows
+(see serviceSnapshot() in display.cpp). Other text printed on the same
+link is skipped, rows that do not check out are left black.
+"""
+import argparse
+import socket
+import struct
+import sys
+import time
+import zlib
+
+DIAG_PORT = 2323
+TIMEOUT = 10
+
+
+def decode_row(payload, width):
+    """RGB565 pixels of a row, None when the runs do not give width pixels"""
+    pixels = []
+    i = 0
+    while i < len(payload):
+        n = payload[i]
+        i += 1
+        if n >= 0x80:
+            if i + 2 > len(payload):
+                return None
+            pixels.extend([(payload[i] << 8) | payload[i + 1]] * (n - 0x7F))
+            i += 2
+        else:
+            count = n + 1
+            if i + 2 * count > len(payload):
+                return None
+            pixels.extend(struct.unpack(">%dH" % count, payload[i:i + 2 * count]))
+            i += 2 * count
+    return pixels if len(pixels) == width else None
+
+
+class Decoder:
+    def __init__(self):
+        self.data = bytearray()
+        self.width = self.height = None
+        self.rows = {}
+        self.done = False
+
+    def feed(self, chunk):
+        self.data += chunk
+        self.parse()
+
+    def parse(self):
+        d = self.data
+        pos = 0
+        while not self.done:
+            if self.width is None:
+                start = d.find(b"SNAP", pos)
+                if start < 0:
+                    pos = max(pos, len(d) - 3)
+                    break
+                if start + 8 > len(d):
+                    pos = start
+                    break
+                self.width, self.height = struct.unpack(">HH", d[start + 4:start + 8])
+                pos = start + 8
+                continue
+            if pos + 4 > len(d):
+                break
+            if d[pos:pos + 4] == b"SEND":
+                self.done = True
+                pos += 4
+                break
+            if d[pos] != ord("R"):
+                pos += 1
+                continue
+            if pos + 5 > len(d):
+                break
+            row, length = struct.unpack(">HH", d[pos + 1:pos + 5])
+            if row >= self.height or length > 6 * self.width:
+                pos += 1
+                continue
+            if pos + 6 + length > len(d):
+                break
+            payload = d[pos + 5:pos + 5 + length]
+            pixels = decode_row(payload, self.width)
+            if pixels is None or (sum(payload) & 0xFF) != d[pos + 5 + length]:
+                pos += 1
+                continue
+            self.rows[row] = pixels
+            pos += 6 + length
+        del d[:pos]
+
+
+def rgb888(pixel):
+    r = (pixel >> 11) & 0x1F
+    g = (pixel >> 5) & 0x3F
+    b = pixel & 0x1F
+    return bytes(((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)))
+
+
+def write_png(path, width, height, rows):
+    raw = bytearray()
+    black = [0] * width
+    for y in range(height):
+        raw.append(0)  # No filter
+        for pixel in rows.get(y, black):
+            raw += rgb888(pixel)
+
+    def chunk(kind, data):
+        return struct.pack(">I", len(data)) + kind + data + struct.pack(">I", zlib.crc32(kind + data) & 0xFFFFFFFF)
+
+    with open(path, "wb") as f:
+        f.write(b"\x89PNG\r\n\x1a\n")
+        f.write(chunk(b"IHDR", struct.pack(">IIBBBBB", width, height, 8, 2, 0, 0, 0)))
+        f.write(chunk(b"IDAT", zlib.compress(bytes(raw), 9)))
+        f.write(chunk(b"IEND", b""))
+
+
+def read_tcp(address, decoder):
+    host, _, port = address.partition(":")
+    with socket.create_connection((host, int(port or DIAG_PORT)), TIMEOUT) as s:
+        s.sendall(b"snap\n")
+        while not decoder.done:
+            chunk = s.recv(4096)
+            if not chunk:
+                break
+            decoder.feed(chunk)
+
+
+def read_serial(device, decoder):
+    import serial
+    with serial.Serial(device, 115200, timeout=1) as s:
+        s.reset_input_buffer()
+        s.write(b"snap\n")
+        last = time.time()
+        while not decoder.done and time.time() - last < TIMEOUT:
+            chunk = s.read(4096)
+            if chunk:
+                decoder.feed(chunk)
+                last = time.time()
+
+
+def read_file(path, decoder):
+    f = sys.stdin.buffer if path == "-" else open(path, "rb")
+    with f:
+        decoder.feed(f.read())
+
+
+def main():
+    parser = argparse.ArgumentParser(description="TSplc_v1 screen snapshot to PNG")
+    parser.add_argument("png")
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("--tcp", metavar="HOST[:PORT]")
+    source.add_argument("--serial", metavar="DEVICE")
+    source.add_argument("--file", metavar="FILE")
+    args = parser.parse_args()
+
+    decoder = Decoder()
+    if args.tcp:
+        read_tcp(args.tcp, decoder)
+    elif args.serial:
+        read_serial(args.serial, decoder)
+    else:
+        read_file(args.file, decoder)
+
+    if decoder.width is None:
+        sys.exit("No snapshot received")
+    write_png(args.png, decoder.width, decoder.height, decoder.rows)
+    missing = decoder.height - len(decoder.rows)
+    print("%s: %dx%d%s" % (args.png, decoder.width, decoder.height,
+                           ", %d rows missing" % missing if missing else ""))
+    if not decoder.done or missing:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()